@@ -1,40 +1,223 @@
 #include "LabelImageQt.h"
 #include <QMouseEvent>
+#include <QPainter>
 #include <QPixmap>
 #include <QImage>
+#include <algorithm>
+#include <cmath>
 
-LabelImage::LabelImage(QWidget *parent) : QLabel(parent)
+LabelImage::LabelImage(QWidget *parent) : QWidget(parent)
 {
     setMouseTracking(true);
-    setAlignment(Qt::AlignCenter);
-    setScaledContents(true);
-    setText("No image loaded.");
+    setMinimumSize(64, 64);
+
+    // Cost in KB, so at most 256 MB of converted tiles are kept
+    tileCache.setMaxCost(256 * 1024);
+}
+
+void LabelImage::setImage(const cv::Mat &bgrImage, double initialZoom)
+{
+    image = bgrImage;
+    tileCache.clear();
+
+    // Halve the resolution until the whole image fits into a few tiles
+    pyramid.clear();
+    pyramid.push_back(image);
+    while (pyramid.back().cols > tileSize * 2 || pyramid.back().rows > tileSize * 2)
+    {
+        cv::Mat next;
+        cv::resize(pyramid.back(), next, cv::Size((pyramid.back().cols + 1) / 2, (pyramid.back().rows + 1) / 2), 0, 0, cv::INTER_AREA);
+        pyramid.push_back(next);
+    }
+
+    if (initialZoom > 0.0)
+    {
+        zoom = initialZoom;
+        offset = QPointF(0.0, 0.0);
+        fitted = false;
+        clampOffset();
+    }
+    else
+    {
+        fitToView();
+    }
+    updateGeometry();
+    update();
+}
+
+QSize LabelImage::sizeHint() const
+{
+    if (image.empty())
+    {
+        return QSize(640, 480);
+    }
+    return QSize(std::min(image.cols, 1280), std::min(image.rows, 720));
+}
+
+void LabelImage::fitToView()
+{
+    fitted = true;
+    if (image.empty() || width() <= 0 || height() <= 0)
+    {
+        return;
+    }
+    zoom = std::min(static_cast<double>(width()) / image.cols, static_cast<double>(height()) / image.rows);
+
+    // Center the image
+    offset = QPointF((image.cols - width() / zoom) / 2.0, (image.rows - height() / zoom) / 2.0);
+}
+
+void LabelImage::clampOffset()
+{
+    // Images smaller than the view are centered, larger ones cannot be panned beyond their borders
+    const double viewWidth = width() / zoom;
+    const double viewHeight = height() / zoom;
+    const double x = (viewWidth >= image.cols) ? (image.cols - viewWidth) / 2.0 : std::clamp(offset.x(), 0.0, image.cols - viewWidth);
+    const double y = (viewHeight >= image.rows) ? (image.rows - viewHeight) / 2.0 : std::clamp(offset.y(), 0.0, image.rows - viewHeight);
+    offset = QPointF(x, y);
+}
+
+QPixmap LabelImage::tile(int level, int tileX, int tileY)
+{
+    const quint64 key = (static_cast<quint64>(level) << 48) | (static_cast<quint64>(tileY) << 24) | static_cast<quint64>(tileX);
+    if (QPixmap *cached = tileCache.object(key))
+    {
+        return *cached;
+    }
+
+    // Convert only this tile from BGR to RGB
+    const cv::Mat &source = pyramid[level];
+    const cv::Rect rect(tileX * tileSize, tileY * tileSize,
+        std::min(tileSize, source.cols - tileX * tileSize), std::min(tileSize, source.rows - tileY * tileSize));
+    cv::Mat rgb;
+    cv::cvtColor(source(rect), rgb, cv::COLOR_BGR2RGB);
+    QImage qImage(rgb.data, rgb.cols, rgb.rows, static_cast<int>(rgb.step[0]), QImage::Format_RGB888);
+    QPixmap *pixmap = new QPixmap(QPixmap::fromImage(qImage));
+    tileCache.insert(key, pixmap, std::max(1, rect.area() * 4 / 1024));
+    return *pixmap;
+}
+
+void LabelImage::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().window());
+    if (image.empty())
+    {
+        painter.drawText(rect(), Qt::AlignCenter, "No image loaded.");
+        return;
+    }
+
+    // Use the coarsest level that still has at least one pixel per displayed pixel
+    int level = 0;
+    while (level + 1 < static_cast<int>(pyramid.size()) && zoom * image.cols / pyramid[level + 1].cols <= 1.0)
+    {
+        ++level;
+    }
+    const cv::Mat &source = pyramid[level];
+    const double levelScaleX = static_cast<double>(source.cols) / image.cols;
+    const double levelScaleY = static_cast<double>(source.rows) / image.rows;
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, zoom < 1.0);
+
+    // Only the tiles of the visible part of the image are drawn
+    const double left = std::max(0.0, offset.x()) * levelScaleX;
+    const double top = std::max(0.0, offset.y()) * levelScaleY;
+    const double right = std::min<double>(image.cols, offset.x() + width() / zoom) * levelScaleX;
+    const double bottom = std::min<double>(image.rows, offset.y() + height() / zoom) * levelScaleY;
+    const int firstTileX = static_cast<int>(left) / tileSize;
+    const int firstTileY = static_cast<int>(top) / tileSize;
+    const int lastTileX = std::min((source.cols - 1) / tileSize, static_cast<int>(std::ceil(right)) / tileSize);
+    const int lastTileY = std::min((source.rows - 1) / tileSize, static_cast<int>(std::ceil(bottom)) / tileSize);
+
+    for (int tileY = firstTileY; tileY <= lastTileY; ++tileY)
+    {
+        for (int tileX = firstTileX; tileX <= lastTileX; ++tileX)
+        {
+            const QPixmap pixmap = tile(level, tileX, tileY);
+            const QRectF target((tileX * tileSize / levelScaleX - offset.x()) * zoom, (tileY * tileSize / levelScaleY - offset.y()) * zoom,
+                pixmap.width() / levelScaleX * zoom, pixmap.height() / levelScaleY * zoom);
+            painter.drawPixmap(target, pixmap, QRectF(pixmap.rect()));
+        }
+    }
 }
 
 void LabelImage::mouseMoveEvent(QMouseEvent *event)
 {
-    if (pixmap().isNull())
+    if (image.empty())
         return;
-    
-    // Get image from the QLabel
-    QImage image = pixmap().toImage();
 
-    // Get the coordinates of the mouse pointer
-    int x = event->pos().x();
-    int y = event->pos().y();
+    if (dragging)
+    {
+        offset = dragStartOffset - (event->position() - dragStart) / zoom;
+        fitted = false;
+        clampOffset();
+        update();
+    }
+
+    // Map the mouse pointer to image coordinates, independent of zoom and window size
+    const int x = static_cast<int>(std::floor(offset.x() + event->position().x() / zoom));
+    const int y = static_cast<int>(std::floor(offset.y() + event->position().y() / zoom));
 
     // Ensure coordinates are within the image bounds
-    if (x >= 0 && x < image.width() && y >= 0 && y < image.height())
+    if (x >= 0 && x < image.cols && y >= 0 && y < image.rows)
     {
-        // Get the pixel value (QRgb) at the mouse coordinates
-        QRgb pixel = image.pixel(x, y);
-
-        // Extract the RGB values
-        int red = qRed(pixel);
-        int green = qGreen(pixel);
-        int blue = qBlue(pixel);
+        // Read the pixel straight from the image buffer
+        const cv::Vec3b &pixel = image.at<cv::Vec3b>(y, x);
 
         // Emit the signal with RGB values
-        emit rgbValueChanged(red, green, blue);
+        emit rgbValueChanged(x, y, pixel[2], pixel[1], pixel[0]);
+    }
+}
+
+void LabelImage::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton)
+    {
+        dragging = true;
+        dragStart = event->position();
+        dragStartOffset = offset;
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+void LabelImage::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton)
+    {
+        dragging = false;
+        unsetCursor();
     }
-}
\ No newline at end of file
+}
+
+void LabelImage::mouseDoubleClickEvent(QMouseEvent *)
+{
+    fitToView();
+    update();
+}
+
+void LabelImage::wheelEvent(QWheelEvent *event)
+{
+    if (image.empty())
+        return;
+
+    // Zoom around the mouse pointer, between a tenth of the fitted size and 32 displayed pixels per image pixel
+    const QPointF anchor = offset + event->position() / zoom;
+    const double fittedZoom = std::min(static_cast<double>(width()) / image.cols, static_cast<double>(height()) / image.rows);
+    const double factor = std::pow(1.0015, event->angleDelta().y());
+    zoom = std::clamp(zoom * factor, fittedZoom / 10.0, 32.0);
+    offset = anchor - event->position() / zoom;
+    fitted = false;
+    clampOffset();
+    update();
+}
+
+void LabelImage::resizeEvent(QResizeEvent *)
+{
+    if (fitted)
+    {
+        fitToView();
+    }
+    else if (!image.empty())
+    {
+        clampOffset();
+    }
+}
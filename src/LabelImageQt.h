@@ -1,22 +1,54 @@
 #ifndef LABEL_IMAGE_H
 #define LABEL_IMAGE_H
 
-#include <QLabel>
+#include <QWidget>
 #include <QMouseEvent>
+#include <QWheelEvent>
+#include <QCache>
+#include <QPixmap>
+#include <opencv2/opencv.hpp>
+#include <vector>
 
-class LabelImage : public QLabel
+// Image view rendering a cv::Mat through a multi-resolution pyramid of cached tiles, with zoom (mouse wheel), pan (drag)
+// and fit to window (double click); the hovered pixel is read directly from the cv::Mat
+class LabelImage : public QWidget
 {
     Q_OBJECT
 
 public:
     explicit LabelImage(QWidget *parent = nullptr); // Constructor
 
+    void setImage(const cv::Mat &image, double zoom = 0.0); // Show a BGR image (shared, not copied), fitted to the view if zoom is 0
+    QSize sizeHint() const override;
+
 signals:
-    void rgbValueChanged(int red, int green, int blue); // Signal to emit RGB values
+    void rgbValueChanged(int x, int y, int red, int green, int blue); // Signal to emit the position and RGB values of the hovered pixel
 
 protected: 
-    void mouseMoveEvent(QMouseEvent * parent) override; // Override mouse move event to get RGB
+    void paintEvent(QPaintEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override; // Override mouse move event to get RGB and pan
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    void fitToView();
+    void clampOffset();
+    QPixmap tile(int level, int tileX, int tileY);
+
+    static const int tileSize = 256;
 
+    cv::Mat image;                          // Source of truth for rendering and pixel lookup (BGR)
+    std::vector<cv::Mat> pyramid;           // Level 0 is the image, every further level halves the resolution
+    QCache<quint64, QPixmap> tileCache;     // RGB tiles converted on demand, limited in memory
+    double zoom = 1.0;                      // Displayed pixels per image pixel
+    QPointF offset;                         // Image coordinates shown at the top left corner of the view
+    bool fitted = true;                     // Keep the image fitted to the view while resizing
+    bool dragging = false;
+    QPointF dragStart;
+    QPointF dragStartOffset;
 };
 
-#endif
\ No newline at end of file
+#endif
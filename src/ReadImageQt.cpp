@@ -1,6 +1,4 @@
 #include "ReadImageQt.h"
-#include <QPixmap>
-#include <QImage>
 #include <opencv2/opencv.hpp>
 
 ReadImageQt::ReadImageQt(QWidget *parent) : QWidget(parent)
@@ -9,7 +7,6 @@ ReadImageQt::ReadImageQt(QWidget *parent) : QWidget(parent)
 
     layout = new QVBoxLayout(this);
     labelImage = new LabelImage(this);
-    labelImage->setMouseTracking(true);
 
     statusBar = new QStatusBar(this);
     statusBar->showMessage("Move your mouse over the image to see the RGB values");
@@ -22,23 +19,17 @@ ReadImageQt::ReadImageQt(QWidget *parent) : QWidget(parent)
 
 void ReadImageQt::showImage(const QString &imagePath, double scaleFactor)
 {
-    cv::Mat image = cv::imread(imagePath.toStdString());
-    if (!image.empty())
+    showImage(cv::imread(imagePath.toStdString()), scaleFactor);
+}
+
+void ReadImageQt::showImage(const cv::Mat &bgrImage, double scaleFactor)
+{
+    if (!bgrImage.empty())
     {
-        // Optionally, scale the image with the provided scaling factor 
-        if (scaleFactor != 1.0)
-        {
-            cv::Size newSize(static_cast<int>(image.cols * scaleFactor), static_cast<int>(image.rows * scaleFactor));
-            cv::resize(image, image, newSize);
-        }
-        
-        // Convert from BGR to RGB for accurate display in Qt
-        cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
-        
-        // Convert the image to QPixmap
-        QImage qImage(image.data, image.cols, image.rows, image.step[0], QImage::Format_RGB888);
-        labelImage->setPixmap(QPixmap::fromImage(qImage));
-        labelImage->resize(qImage.size());
+        // The view shares the image buffer and converts only the visible tiles for display,
+        // so neither the caller's image nor a scaled copy of it has to be converted as a whole
+        labelImage->setImage(bgrImage, scaleFactor);
+        statusBar->showMessage(QString("%1 x %2 pixels - scroll to zoom, drag to pan, double click to fit").arg(bgrImage.cols).arg(bgrImage.rows));
     }
     else
     {
@@ -46,7 +37,7 @@ void ReadImageQt::showImage(const QString &imagePath, double scaleFactor)
     }
 }
 
-void ReadImageQt::updateStatusBar(int r, int g, int b)
+void ReadImageQt::updateStatusBar(int x, int y, int r, int g, int b)
 {
-    statusBar->showMessage(QString("R: %1, G: %2, B: %3").arg(r).arg(g).arg(b));
+    statusBar->showMessage(QString("X: %1, Y: %2 - R: %3, G: %4, B: %5").arg(x).arg(y).arg(r).arg(g).arg(b));
 }
\ No newline at end of file
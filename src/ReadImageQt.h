@@ -4,6 +4,7 @@
 #include <QWidget>
 #include <QVBoxLayout>
 #include <QStatusBar>
+#include <opencv2/opencv.hpp>
 #include "LabelImageQt.h"
 
 class ReadImageQt : public QWidget
@@ -12,7 +13,8 @@ class ReadImageQt : public QWidget
 
 public:
     ReadImageQt(QWidget *parent = nullptr);
-    void showImage(const QString &imagePath, double scaleFactor = 1.0);
+    void showImage(const QString &imagePath, double scaleFactor = 0.0);
+    void showImage(const cv::Mat &image, double scaleFactor = 0.0); // A scaleFactor of 0 fits the image to the window
 
 private:
     LabelImage *labelImage;
@@ -20,7 +22,7 @@ private:
     QVBoxLayout *layout;
 
 private slots:
-    void updateStatusBar(int r, int g, int b);
+    void updateStatusBar(int x, int y, int r, int g, int b);
 };
 
 #endif 
\ No newline at end of file
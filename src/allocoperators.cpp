@@ -0,0 +1,70 @@
+#include <cstdlib>
+#include <new>
+#include "alloctrack.h"
+
+// Replacements of the global operators new and delete, counting while allocation tracking is switched on
+// (only linked into the executable, so applications embedding the enhancer library keep their own operators)
+
+void* operator new(std::size_t size)
+{
+    recordAllocation(size);
+    void* pointer = std::malloc(size ? size : 1);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    recordAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    recordAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    recordDeallocation(pointer);
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    recordDeallocation(pointer);
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    recordDeallocation(pointer);
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    recordDeallocation(pointer);
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    recordDeallocation(pointer);
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    recordDeallocation(pointer);
+    std::free(pointer);
+}
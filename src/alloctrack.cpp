@@ -0,0 +1,120 @@
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdio>
+#include "alloctrack.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+static std::atomic<bool> trackingEnabled(false);
+static std::atomic<uint64_t> newCalls(0);
+static std::atomic<uint64_t> newBytes(0);
+static std::atomic<uint64_t> deleteCalls(0);
+static std::atomic<uint64_t> matAllocations(0);
+static std::atomic<uint64_t> matBytes(0);
+
+void recordAllocation(const std::size_t size)
+{
+    if (trackingEnabled.load(std::memory_order_relaxed))
+    {
+        newCalls.fetch_add(1, std::memory_order_relaxed);
+        newBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void recordDeallocation(const void* pointer)
+{
+    if (pointer != nullptr && trackingEnabled.load(std::memory_order_relaxed))
+    {
+        deleteCalls.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Counts the buffers of all cv::Mat created through the default allocator and leaves the actual work to OpenCV's standard allocator
+// (deallocation goes back to the standard allocator directly, as it is recorded in every buffer it allocates)
+class TrackingMatAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        cv::UMatData* u = cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if (u != nullptr && data == nullptr)
+        {
+            matAllocations.fetch_add(1, std::memory_order_relaxed);
+            matBytes.fetch_add(u->size, std::memory_order_relaxed);
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const override
+    {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+void setAllocationTrackingEnabled(const bool enabled)
+{
+    static TrackingMatAllocator matAllocator;
+    cv::Mat::setDefaultAllocator(enabled ? &matAllocator : nullptr);
+    trackingEnabled = enabled;
+}
+
+bool isAllocationTrackingEnabled()
+{
+    return trackingEnabled;
+}
+
+AllocationCounts getAllocationCounts()
+{
+    AllocationCounts counts;
+    counts.newCalls = newCalls.load(std::memory_order_relaxed);
+    counts.newBytes = newBytes.load(std::memory_order_relaxed);
+    counts.deleteCalls = deleteCalls.load(std::memory_order_relaxed);
+    counts.matAllocations = matAllocations.load(std::memory_order_relaxed);
+    counts.matBytes = matBytes.load(std::memory_order_relaxed);
+    return counts;
+}
+
+uint64_t getCurrentRSS()
+{
+#ifdef __linux__
+    // The second field of statm is the number of resident pages
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+    {
+        return 0;
+    }
+    unsigned long long size = 0;
+    unsigned long long resident = 0;
+    const int fields = std::fscanf(statm, "%llu %llu", &size, &resident);
+    std::fclose(statm);
+    return (fields == 2) ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+uint64_t getPeakRSS()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
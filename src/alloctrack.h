@@ -0,0 +1,37 @@
+#ifndef ALLOC_TRACK_H
+#define ALLOC_TRACK_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Process-wide allocation counts since tracking was switched on
+struct AllocationCounts
+{
+    uint64_t newCalls = 0;                      // calls of the global operator new (std::map nodes, std::vector buffers, ...)
+    uint64_t newBytes = 0;                      // bytes requested through operator new
+    uint64_t deleteCalls = 0;                   // calls of the global operator delete
+    uint64_t matAllocations = 0;                // cv::Mat buffers allocated through the default allocator
+    uint64_t matBytes = 0;                      // bytes of these cv::Mat buffers
+};
+
+// Function to switch allocation tracking on or off; switching it on installs a counting cv::MatAllocator as the default one
+// (allocations are counted across all threads, so per-stage figures are exact with a single file/frame worker)
+void setAllocationTrackingEnabled(const bool enabled);
+
+// Function to check whether allocation tracking is switched on
+bool isAllocationTrackingEnabled();
+
+// Function to get the allocation counts so far
+AllocationCounts getAllocationCounts();
+
+// Functions to count an allocation/deallocation through the global operators new and delete (see allocoperators.cpp)
+void recordAllocation(const std::size_t size);
+void recordDeallocation(const void* pointer);
+
+// Function to get the current resident memory of the process in bytes (0 if unknown)
+uint64_t getCurrentRSS();
+
+// Function to get the peak resident memory of the process in bytes (0 if unknown)
+uint64_t getPeakRSS();
+
+#endif
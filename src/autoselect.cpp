@@ -0,0 +1,229 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "autoselect.h"
+#include "scheduler.h"
+
+// Transform types the "auto" transform type chooses from
+static const char* const transformTypes[] = {"log", "globHE", "locHE", "AGCWHD"};
+
+FrameFeatures computeFrameFeatures(const cv::Mat& frame, const int L, const int sampleStep)
+{
+    FrameFeatures features;
+    const int maxL = L - 1;
+    std::vector<int> hist(std::max(L, 256), 0);
+    int count = 0;
+
+    for (int y = sampleStep / 2; y < frame.rows; y += sampleStep)
+    {
+        const uchar* row = frame.ptr<uchar>(y);
+        for (int x = sampleStep / 2; x < frame.cols; x += sampleStep)
+        {
+            const int intensity = (frame.channels() == 3) ? (row[3 * x] + row[3 * x + 1] + row[3 * x + 2]) / 3 : row[x];
+            hist[intensity]++;
+            count++;
+        }
+    }
+    if (count == 0 || maxL <= 0)
+    {
+        return features;
+    }
+
+    // Mean, variance and the 1st/99th percentile from the histogram
+    double sum = 0.0;
+    double squareSum = 0.0;
+    for (int value = 0; value < static_cast<int>(hist.size()); ++value)
+    {
+        sum += static_cast<double>(value) * hist[value];
+        squareSum += static_cast<double>(value) * value * hist[value];
+    }
+    const double mean = sum / count;
+    const double variance = squareSum / count - mean * mean;
+
+    int low = -1;
+    int high = 0;
+    int cumulative = 0;
+    for (int value = 0; value < static_cast<int>(hist.size()); ++value)
+    {
+        cumulative += hist[value];
+        if (low < 0 && cumulative > 0.01 * count)
+        {
+            low = value;
+        }
+        if (cumulative <= 0.99 * count)
+        {
+            high = value + 1;
+        }
+    }
+    high = std::max(high, low);
+
+    features.darkness = std::clamp(1.0 - mean / maxL, 0.0, 1.0);
+    features.dynamicRange = std::clamp(static_cast<double>(high - low) / maxL, 0.0, 1.0);
+
+    // Otsu's separability (best between-class variance over the total variance) is 2 / pi for a single Gaussian mode
+    // and 1 for two separated modes, so it is rescaled to that interval
+    if (variance > 1e-9)
+    {
+        double bestBetween = 0.0;
+        double weightLow = 0.0;
+        double sumLow = 0.0;
+        for (int value = 0; value < static_cast<int>(hist.size()) - 1; ++value)
+        {
+            weightLow += hist[value];
+            sumLow += static_cast<double>(value) * hist[value];
+            const double weightHigh = count - weightLow;
+            if (weightLow == 0.0 || weightHigh == 0.0)
+            {
+                continue;
+            }
+            const double meanLow = sumLow / weightLow;
+            const double meanHigh = (sum - sumLow) / weightHigh;
+            const double between = (weightLow / count) * (weightHigh / count) * (meanLow - meanHigh) * (meanLow - meanHigh);
+            bestBetween = std::max(bestBetween, between);
+        }
+        const double gaussianSeparability = 2.0 / CV_PI;
+        features.bimodality = std::clamp((bestBetween / variance - gaussianSeparability) / (1.0 - gaussianSeparability), 0.0, 1.0);
+    }
+    return features;
+}
+
+const std::map<std::string, double>& getTransformCosts(const EnhancementSettings& settings)
+{
+    static std::mutex costsMutex;
+    static std::map<std::string, std::map<std::string, double>> costsByParameters;
+
+    // Only the parameters that change the amount of work of a transform are part of the key
+    std::ostringstream key;
+    key << settings.L << "|" << settings.clipLimit << "|" << settings.tileGridSize.width << "x" << settings.tileGridSize.height
+        << "|" << settings.fastMath << "|" << settings.gainMapScale << "|" << settings.tileSkipSize;
+
+    // Hold the lock while measuring, so concurrent workers wait for one measurement instead of disturbing it
+    std::lock_guard<std::mutex> lock(costsMutex);
+    const auto cached = costsByParameters.find(key.str());
+    if (cached != costsByParameters.end())
+    {
+        return cached->second;
+    }
+
+    // A dark, noisy synthetic frame at the size frames are processed at
+    cv::Mat synthetic(360, 640, CV_8UC3);
+    cv::RNG rng(1);
+    rng.fill(synthetic, cv::RNG::NORMAL, cv::Scalar::all(40), cv::Scalar::all(12));
+    for (int y = 0; y < synthetic.rows; ++y)
+    {
+        cv::Vec3b* row = synthetic.ptr<cv::Vec3b>(y);
+        for (int x = synthetic.cols / 2; x < synthetic.cols; ++x)
+        {
+            row[x] = cv::Vec3b(row[x][0] / 2, row[x][1] / 2, row[x][2] / 2);
+        }
+    }
+
+    std::map<std::string, double>& costs = costsByParameters[key.str()];
+    EnhancementSettings probeSettings = settings;
+    cv::Mat probe;
+    for (const char* transformType : transformTypes)
+    {
+        probeSettings.transformType = transformType;
+
+        // One warm-up run (lookup tables, CLAHE objects, thread pool), then the fastest of three timed runs
+        double bestSeconds = std::numeric_limits<double>::max();
+        for (int run = 0; run < 4; ++run)
+        {
+            synthetic.copyTo(probe);
+            const int64 start = cv::getTickCount();
+            enhanceFrame(probe, probeSettings, "", false);
+            const double seconds = static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency();
+            if (run > 0)
+            {
+                bestSeconds = std::min(bestSeconds, seconds);
+            }
+        }
+        costs[transformType] = 1e9 * bestSeconds / synthetic.total();
+    }
+    return costs;
+}
+
+double predictTransformQuality(const std::string& transformType, const FrameFeatures& features)
+{
+    // Heuristic model of how well each transform handles a frame:
+    // the logarithmic transformation and the global methods wash out the bright mode of bimodal frames,
+    // the logarithmic transformation also over-brightens frames that are not dark,
+    // global equalization amplifies the noise of flat frames with a narrow range,
+    // AGCWHD adapts its gamma to the histogram and CLAHE works locally, so both depend little on the features
+    const double notDark = std::max(0.0, 0.6 - features.darkness);
+    const double narrowRange = std::max(0.0, 0.2 - features.dynamicRange) / 0.2;
+    double quality = 0.0;
+    if (transformType == "log")
+    {
+        quality = 0.95 - 0.5 * features.bimodality - 0.5 * notDark;
+    }
+    else if (transformType == "globHE")
+    {
+        quality = 0.9 - 0.4 * features.bimodality - 0.3 * narrowRange;
+    }
+    else if (transformType == "AGCWHD")
+    {
+        quality = 0.92 - 0.2 * features.bimodality - 0.1 * narrowRange;
+    }
+    else if (transformType == "locHE")
+    {
+        quality = 0.88 - 0.1 * narrowRange;
+    }
+    return std::clamp(quality, 0.0, 1.0);
+}
+
+TransformDecision selectTransform(const cv::Mat& frame, const EnhancementSettings& settings)
+{
+    TransformDecision decision;
+    decision.features = computeFrameFeatures(frame, settings.L);
+    const std::map<std::string, double>& costs = getTransformCosts(settings);
+
+    // Frames of concurrent workers share the time of one frame at the target rate
+    const double budgetMs = (settings.autoTargetFps > 0.0) ? 1000.0 * getThreadBudget().frameWorkers / settings.autoTargetFps : 0.0;
+
+    const std::string* cheapest = nullptr;
+    const std::string* cheapestGood = nullptr;
+    const std::string* bestFitting = nullptr;
+    double bestFittingQuality = -1.0;
+    for (const auto& cost : costs)
+    {
+        const double quality = predictTransformQuality(cost.first, decision.features);
+        const double predictedMs = 1e-6 * cost.second * frame.total();
+        if (cheapest == nullptr || cost.second < costs.at(*cheapest))
+        {
+            cheapest = &cost.first;
+        }
+        if (budgetMs > 0.0 && predictedMs > budgetMs)
+        {
+            continue;
+        }
+        if (quality >= settings.autoQuality && (cheapestGood == nullptr || cost.second < costs.at(*cheapestGood)))
+        {
+            cheapestGood = &cost.first;
+        }
+        if (quality > bestFittingQuality)
+        {
+            bestFitting = &cost.first;
+            bestFittingQuality = quality;
+        }
+    }
+
+    decision.transformType = *(cheapestGood != nullptr ? cheapestGood : (bestFitting != nullptr ? bestFitting : cheapest));
+    decision.predictedQuality = predictTransformQuality(decision.transformType, decision.features);
+    decision.predictedMs = 1e-6 * costs.at(decision.transformType) * frame.total();
+    return decision;
+}
+
+void printTransformDecision(const TransformDecision& decision, std::ostream& out)
+{
+    out << std::fixed << std::setprecision(2)
+        << "Auto transform: " << decision.transformType
+        << " (darkness " << decision.features.darkness << ", dynamic range " << decision.features.dynamicRange
+        << ", bimodality " << decision.features.bimodality << ", predicted quality " << decision.predictedQuality
+        << ", predicted time " << decision.predictedMs << " ms)" << std::defaultfloat << "\n";
+}
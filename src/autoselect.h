@@ -0,0 +1,44 @@
+#ifndef AUTO_SELECT_H
+#define AUTO_SELECT_H
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <map>
+#include <string>
+#include "processor.h"
+
+// Cheap features of a frame, computed from the histogram of a sparse sample of its intensities
+struct FrameFeatures
+{
+    double darkness = 0.0;                      // 1 - mean intensity relative to L - 1 (1 = black)
+    double dynamicRange = 0.0;                  // distance between the 1st and 99th percentile relative to L - 1
+    double bimodality = 0.0;                    // Otsu's separability beyond that of a single Gaussian mode (0 = unimodal, 1 = two separated modes)
+};
+
+// Decision of the "auto" transform type for one frame
+struct TransformDecision
+{
+    std::string transformType;                  // chosen transform type
+    FrameFeatures features;
+    double predictedQuality = 0.0;              // predicted quality of the chosen transform (0 - 1)
+    double predictedMs = 0.0;                   // predicted time of the chosen transform on this frame
+};
+
+// Function to compute the features of a BGR frame (mean of the channels) or a single-channel luma plane, sampling every sampleStep-th row and column
+FrameFeatures computeFrameFeatures(const cv::Mat& frame, const int L, const int sampleStep = 4);
+
+// Function to get the cost of every transform type on this host in nanoseconds per pixel
+// (measured once per set of cost-relevant parameters on a synthetic dark frame)
+const std::map<std::string, double>& getTransformCosts(const EnhancementSettings& settings);
+
+// Function to predict the quality (0 - 1) of a transform type for a frame with the given features
+double predictTransformQuality(const std::string& transformType, const FrameFeatures& features);
+
+// Function to pick the cheapest transform type predicted to reach settings.autoQuality that also fits settings.autoTargetFps
+// (the best predicted one within the throughput target if none reaches the quality, the cheapest one if none fits the target)
+TransformDecision selectTransform(const cv::Mat& frame, const EnhancementSettings& settings);
+
+// Function to print a decision with the features it was based on
+void printTransformDecision(const TransformDecision& decision, std::ostream& out = std::cout);
+
+#endif
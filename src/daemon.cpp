@@ -0,0 +1,520 @@
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include "processor.h"
+#include "manifest.h"
+#include "daemon.h"
+#include "scheduler.h"
+#include "enhancer.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DAEMON_SUPPORTED 1
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#define DAEMON_SUPPORTED 0
+#endif
+
+static std::string escapeJson(const std::string& text)
+{
+    std::string escaped;
+    for (const char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += (c == '\n') ? ' ' : c;
+    }
+    return escaped;
+}
+
+static std::string buildReply(const std::string& status, const std::string& message, const std::string& modFilePath, const double seconds)
+{
+    std::ostringstream reply;
+    reply << "{\"status\": \"" << status << "\", \"seconds\": " << seconds;
+    if (!modFilePath.empty())
+    {
+        reply << ", \"modFile\": \"" << escapeJson(modFilePath) << "\"";
+    }
+    if (!message.empty())
+    {
+        reply << ", \"message\": \"" << escapeJson(message) << "\"";
+    }
+    reply << "}";
+    return reply.str();
+}
+
+#if DAEMON_SUPPORTED
+static bool enhanceSharedMemoryFrame(const cv::FileNode& node, Enhancer& enhancer, std::string& errorMessage)
+{
+    // The frame is a BGR image of the given size, written by the client into a POSIX shared memory object
+    const std::string shmName = node["shm"].string();
+    const cv::FileNode widthNode = node["width"];
+    const cv::FileNode heightNode = node["height"];
+    if (!widthNode.isInt() || !heightNode.isInt() || static_cast<int>(widthNode) <= 0 || static_cast<int>(heightNode) <= 0)
+    {
+        errorMessage = "shared memory frames require positive 'width' and 'height'";
+        return false;
+    }
+    const int width = static_cast<int>(widthNode);
+    const int height = static_cast<int>(heightNode);
+    const size_t frameSize = static_cast<size_t>(width) * height * 3;
+
+    EnhancementSettings settings;
+    if (!readEnhancementSettings(node, settings, errorMessage))
+    {
+        return false;
+    }
+
+    const int fd = shm_open(shmName.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        errorMessage = "shared memory object '" + shmName + "' could not be opened";
+        return false;
+    }
+    struct stat shmStat;
+    if (fstat(fd, &shmStat) != 0 || static_cast<size_t>(shmStat.st_size) < frameSize)
+    {
+        close(fd);
+        errorMessage = "shared memory object is smaller than the frame";
+        return false;
+    }
+    void* data = mmap(nullptr, frameSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        errorMessage = "shared memory object could not be mapped";
+        return false;
+    }
+
+    // Enhance in place, the enhancer writes its result back into the shared buffer
+    cv::Mat frame(height, width, CV_8UC3, data);
+    enhancer.configure(settings);
+    enhancer.enhance(frame, frame);
+    munmap(data, frameSize);
+    return true;
+}
+#endif
+
+std::string handleDaemonRequest(const std::string& request, bool& shutdownRequested, Enhancer* enhancer)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto elapsed = [&start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+    cv::FileStorage fs;
+    try
+    {
+        fs.open(request, cv::FileStorage::READ | cv::FileStorage::MEMORY | cv::FileStorage::FORMAT_JSON);
+    }
+    catch (const std::exception&)
+    {
+        return buildReply("error", "request could not be parsed", "", elapsed());
+    }
+    const cv::FileNode node = fs.root();
+    if (!node.isMap())
+    {
+        return buildReply("error", "request is not a JSON object", "", elapsed());
+    }
+
+    if (node["command"].isString() && node["command"].string() == "shutdown")
+    {
+        shutdownRequested = true;
+        return buildReply("ok", "shutting down", "", elapsed());
+    }
+
+    std::string errorMessage;
+    try
+    {
+#if DAEMON_SUPPORTED
+        if (node["shm"].isString())
+        {
+            Enhancer localEnhancer;
+            const bool success = enhanceSharedMemoryFrame(node, (enhancer != nullptr) ? *enhancer : localEnhancer, errorMessage);
+            return buildReply(success ? "ok" : "error", errorMessage, "", elapsed());
+        }
+#endif
+        JobSpec job;
+        if (!readJobSpec(node, job, errorMessage))
+        {
+            return buildReply("error", errorMessage, "", elapsed());
+        }
+        std::string modFilePath;
+        const bool success = runJob(job, modFilePath);
+        return buildReply(success ? "ok" : "failed", "", modFilePath, elapsed());
+    }
+    catch (const std::exception& e)
+    {
+        // OpenCV errors, failed allocations and any other exception of a job only fail this request
+        return buildReply("failed", e.what(), "", elapsed());
+    }
+}
+
+#if DAEMON_SUPPORTED
+static bool sendAll(const int fd, const std::string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        const ssize_t count = send(fd, data.data() + sent, data.size() - sent, 0);
+        if (count <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+// Requests and replies are single lines of JSON
+static const size_t maxLineLength = 1 << 20;
+
+// A request read by the daemon and queued for its workers
+struct PendingRequest
+{
+    int fd = -1;
+    std::string request;
+};
+
+// A reply sent by a worker of the daemon, reported back to the dispatching thread
+struct FinishedRequest
+{
+    int fd = -1;
+    bool keepOpen = true;
+    bool shutdownRequested = false;
+};
+
+// A client connection of the daemon with its unread bytes; busy while one of its requests is processed
+struct Connection
+{
+    int fd = -1;
+    std::string buffer;
+    bool busy = false;
+};
+
+static bool readLine(const int fd, std::string& buffer, std::string& line)
+{
+    while (true)
+    {
+        const size_t newline = buffer.find('\n');
+        if (newline != std::string::npos)
+        {
+            line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return true;
+        }
+        if (buffer.size() > maxLineLength)
+        {
+            return false;
+        }
+        char chunk[4096];
+        const ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+        if (count <= 0)
+        {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(count));
+    }
+}
+
+static int createUnixSocket(const std::string& socketPath, sockaddr_un& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Error: Socket path is too long." << "\n";
+        return -1;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+#endif
+
+int runDaemon(const std::string& socketPath, const int workerCount, const bool verbose)
+{
+#if DAEMON_SUPPORTED
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address;
+    const int listenFd = createUnixSocket(socketPath, address);
+    if (listenFd < 0)
+    {
+        std::cerr << "Error: Socket could not be created." << "\n";
+        return -1;
+    }
+    unlink(socketPath.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, 64) != 0)
+    {
+        std::cerr << "Error: Socket could not be bound to " << socketPath << "\n";
+        close(listenFd);
+        return -1;
+    }
+
+    // Workers report finished requests through a pipe, which wakes up the poll() of the dispatching thread
+    int wakePipe[2];
+    if (pipe(wakePipe) != 0)
+    {
+        std::cerr << "Error: Daemon pipe could not be created." << "\n";
+        close(listenFd);
+        return -1;
+    }
+
+    std::queue<PendingRequest> pendingRequests;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::atomic<bool> stop(false);
+
+    // Each worker serves one request at a time, so an idle connection never holds on to a worker;
+    // it keeps one Enhancer for all shared memory frames, so their buffers are allocated once per worker
+    const auto serveRequests = [&]()
+    {
+        Enhancer enhancer;
+        while (true)
+        {
+            PendingRequest pending;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [&]() { return stop || !pendingRequests.empty(); });
+                if (stop)
+                {
+                    return;
+                }
+                pending = pendingRequests.front();
+                pendingRequests.pop();
+            }
+
+            bool shutdownRequested = false;
+            const std::string reply = handleDaemonRequest(pending.request, shutdownRequested, &enhancer);
+            if (verbose)
+            {
+                std::cout << "Request: " << pending.request << "\n" << "Reply: " << reply << "\n";
+            }
+            FinishedRequest finished;
+            finished.fd = pending.fd;
+            finished.keepOpen = sendAll(pending.fd, reply + "\n");
+            finished.shutdownRequested = shutdownRequested;
+            if (write(wakePipe[1], &finished, sizeof(finished)) != static_cast<ssize_t>(sizeof(finished)))
+            {
+                std::cerr << "Error: Daemon pipe could not be written." << "\n";
+            }
+        }
+    };
+
+    // Share the cores between the workers, so concurrent requests do not oversubscribe OpenCV's pool
+    ThreadBudget budget;
+    budget.fileWorkers = std::max(1, workerCount);
+    setThreadBudget(planThreadBudget(budget));
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < std::max(1, workerCount); ++w)
+    {
+        workers.emplace_back(serveRequests);
+    }
+    if (verbose)
+    {
+        std::cout << "Daemon listening on " << socketPath << " with " << workers.size() << " workers\n";
+    }
+
+    // The dispatching thread reads all connections and queues their requests; a connection has at most one request
+    // in flight (so its replies stay in order) and is not polled until the reply is sent
+    std::map<int, Connection> connections;
+    const auto dispatch = [&](Connection& connection)
+    {
+        const size_t newline = connection.buffer.find('\n');
+        if (connection.busy || newline == std::string::npos)
+        {
+            return;
+        }
+        PendingRequest pending;
+        pending.fd = connection.fd;
+        pending.request = connection.buffer.substr(0, newline);
+        connection.buffer.erase(0, newline + 1);
+        connection.busy = true;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            pendingRequests.push(pending);
+        }
+        queueCondition.notify_one();
+    };
+    const auto closeConnection = [&](const int fd)
+    {
+        close(fd);
+        connections.erase(fd);
+    };
+
+    bool shutdownRequested = false;
+    while (!shutdownRequested)
+    {
+        std::vector<pollfd> pollFds;
+        pollFds.push_back({listenFd, POLLIN, 0});
+        pollFds.push_back({wakePipe[0], POLLIN, 0});
+        for (const auto& entry : connections)
+        {
+            if (!entry.second.busy)
+            {
+                pollFds.push_back({entry.first, POLLIN, 0});
+            }
+        }
+        if (poll(pollFds.data(), pollFds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "Error: Daemon could not poll its connections." << "\n";
+            break;
+        }
+
+        if (pollFds[1].revents & POLLIN)
+        {
+            FinishedRequest finished;
+            if (read(wakePipe[0], &finished, sizeof(finished)) == static_cast<ssize_t>(sizeof(finished)))
+            {
+                shutdownRequested = shutdownRequested || finished.shutdownRequested;
+                const auto it = connections.find(finished.fd);
+                if (it != connections.end())
+                {
+                    it->second.busy = false;
+                    if (finished.keepOpen)
+                    {
+                        dispatch(it->second);
+                    }
+                    else
+                    {
+                        closeConnection(finished.fd);
+                    }
+                }
+            }
+        }
+
+        for (size_t p = 2; p < pollFds.size(); ++p)
+        {
+            if (pollFds[p].revents == 0)
+            {
+                continue;
+            }
+            Connection& connection = connections[pollFds[p].fd];
+            char chunk[4096];
+            const ssize_t count = recv(connection.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (count == 0 || (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                closeConnection(pollFds[p].fd);
+                continue;
+            }
+            if (count > 0)
+            {
+                connection.buffer.append(chunk, static_cast<size_t>(count));
+            }
+            dispatch(connection);
+            if (!connection.busy && connection.buffer.size() > maxLineLength)
+            {
+                closeConnection(pollFds[p].fd);
+            }
+        }
+
+        if (pollFds[0].revents & POLLIN)
+        {
+            const int fd = accept(listenFd, nullptr, nullptr);
+            if (fd >= 0)
+            {
+                Connection& connection = connections[fd];
+                connection.fd = fd;
+            }
+        }
+    }
+
+    // Requests still queued are dropped; shutting down the connections unblocks workers sending to clients that do not read
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stop = true;
+    }
+    queueCondition.notify_all();
+    for (const auto& entry : connections)
+    {
+        shutdown(entry.first, SHUT_RDWR);
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    for (const auto& entry : connections)
+    {
+        close(entry.first);
+    }
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    close(listenFd);
+    unlink(socketPath.c_str());
+    return 0;
+#else
+    std::cerr << "Error: Daemon mode is only supported on Unix-like systems." << "\n";
+    return -1;
+#endif
+}
+
+int runClient(const std::string& socketPath, const std::string& request, const int repeat)
+{
+#if DAEMON_SUPPORTED
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address;
+    const int fd = createUnixSocket(socketPath, address);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        std::cerr << "Error: Could not connect to the daemon at " << socketPath << "\n";
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // Send the request repeatedly over one connection to measure round-trip latency and throughput
+    std::string buffer;
+    std::string reply;
+    double totalSeconds = 0.0;
+    int completed = 0;
+    for (int r = 0; r < std::max(1, repeat); ++r)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (!sendAll(fd, request + "\n") || !readLine(fd, buffer, reply))
+        {
+            std::cerr << "Error: Connection to the daemon was closed." << "\n";
+            break;
+        }
+        totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        completed++;
+        std::cout << reply << "\n";
+    }
+    close(fd);
+
+    if (completed > 1)
+    {
+        std::cout << "Requests: " << completed << ", mean latency: " << 1000.0 * totalSeconds / completed
+            << " ms, throughput: " << completed / totalSeconds << " requests/s\n";
+    }
+    return (completed == std::max(1, repeat)) ? 0 : -1;
+#else
+    std::cerr << "Error: Daemon mode is only supported on Unix-like systems." << "\n";
+    return -1;
+#endif
+}
@@ -0,0 +1,18 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <string>
+
+class Enhancer;
+
+// Function to handle a single JSON request (a manifest job, a shared memory frame or a shutdown command) and build the JSON reply
+// (if provided, shared memory frames are enhanced with enhancer, so its buffers are reused across requests)
+std::string handleDaemonRequest(const std::string& request, bool& shutdownRequested, Enhancer* enhancer = nullptr);
+
+// Function to serve enhancement requests on a Unix domain socket with a persistent pool of workers
+int runDaemon(const std::string& socketPath, const int workerCount = 4, const bool verbose = false);
+
+// Function to send a request to a running daemon (optionally several times) and print the replies with latency and throughput
+int runClient(const std::string& socketPath, const std::string& request, const int repeat = 1);
+
+#endif
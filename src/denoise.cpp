@@ -0,0 +1,111 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <vector>
+#include "denoise.h"
+
+// Rows the row kernels process at a time, so the scratch of a band stays in cache
+static const int bandRows = 8;
+
+TemporalDenoiser::TemporalDenoiser(const int historyLength, const double threshold)
+    : historyLength(std::clamp(historyLength, 1, maxDenoiseFrames)),
+      threshold(std::clamp(cvRound(threshold), 0, 255))
+{
+    // One slot more than the previous frames, so the slot the current frame is stored in never is one of them
+    history.resize(this->historyLength + 1);
+}
+
+void TemporalDenoiser::apply(cv::Mat& frame)
+{
+    CV_Assert(frame.type() == CV_8UC3);
+
+    // (Re)allocate the ring buffer once per frame size; each slot row holds the row's B, G and R planes after another
+    const cv::Size planarSize(3 * frame.cols, frame.rows);
+    if (history[0].size() != planarSize)
+    {
+        for (cv::Mat& slot : history)
+        {
+            slot.create(planarSize, CV_8U);
+        }
+        filled = 0;
+        nextSlot = 0;
+    }
+
+    const int slots = static_cast<int>(history.size());
+    const int used = filled;
+    const int slot = nextSlot;
+    const int gate = threshold;
+    const int cols = frame.cols;
+    const int bands = (frame.rows + bandRows - 1) / bandRows;
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range)
+    {
+        // Per-thread scratch for one band, only allocated for the first band or if the frame width changes
+        thread_local cv::Mat differenceBuffer, motionBuffer, weightBuffer, weightsBuffer, sumsBuffer;
+        differenceBuffer.create(bandRows, 3 * cols, CV_8U);
+        motionBuffer.create(bandRows, cols, CV_8U);
+        weightBuffer.create(bandRows, cols, CV_8U);
+        weightsBuffer.create(bandRows, cols, CV_32F);
+        sumsBuffer.create(bandRows, 3 * cols, CV_32F);
+
+        for (int band = range.start; band < range.end; ++band)
+        {
+            const cv::Range rowRange(band * bandRows, std::min(frame.rows, (band + 1) * bandRows));
+            const int height = rowRange.size();
+
+            // Store the current frame's planes, which the row kernels below then work on
+            const cv::Mat current = history[slot].rowRange(rowRange);
+            std::vector<cv::Mat> planes = {current.colRange(0, cols), current.colRange(cols, 2 * cols), current.colRange(2 * cols, 3 * cols)};
+            cv::split(frame.rowRange(rowRange), planes);
+            if (used == 0)
+            {
+                continue;
+            }
+
+            // The current pixel has the full weight, previous pixels lose weight linearly with their largest channel
+            // difference and are ignored from the threshold on, so moving content does not leave ghosts behind
+            cv::Mat difference = differenceBuffer.rowRange(0, height);
+            cv::Mat motion = motionBuffer.rowRange(0, height);
+            cv::Mat weight = weightBuffer.rowRange(0, height);
+            cv::Mat weights = weightsBuffer.rowRange(0, height);
+            cv::Mat sums = sumsBuffer.rowRange(0, height);
+            weights.setTo(gate);
+            current.convertTo(sums, CV_32F, gate);
+            for (int k = 0; k < used; ++k)
+            {
+                const cv::Mat previous = history[(slot - 1 - k + slots) % slots].rowRange(rowRange);
+                cv::absdiff(previous, current, difference);
+                cv::max(difference.colRange(0, cols), difference.colRange(cols, 2 * cols), motion);
+                cv::max(motion, difference.colRange(2 * cols, 3 * cols), motion);
+                cv::subtract(cv::Scalar::all(gate), motion, weight);
+                cv::accumulate(weight, weights);
+                for (int c = 0; c < 3; ++c)
+                {
+                    cv::Mat planeSums = sums.colRange(c * cols, (c + 1) * cols);
+                    cv::accumulateProduct(weight, previous.colRange(c * cols, (c + 1) * cols), planeSums);
+                }
+            }
+
+            // The sums are integers below 2^24, so they are exact in float and the rounded division matches integer math
+            for (int y = 0; y < height; ++y)
+            {
+                uchar* row = frame.ptr<uchar>(rowRange.start + y);
+                const float* weightRow = weights.ptr<float>(y);
+                const float* sumRow = sums.ptr<float>(y);
+                for (int x = 0; x < cols; ++x)
+                {
+                    const int weightSum = static_cast<int>(weightRow[x]);
+                    if (weightSum > gate)
+                    {
+                        const int half = weightSum / 2;
+                        row[3 * x] = static_cast<uchar>((static_cast<int>(sumRow[x]) + half) / weightSum);
+                        row[3 * x + 1] = static_cast<uchar>((static_cast<int>(sumRow[cols + x]) + half) / weightSum);
+                        row[3 * x + 2] = static_cast<uchar>((static_cast<int>(sumRow[2 * cols + x]) + half) / weightSum);
+                    }
+                }
+            }
+        }
+    });
+
+    nextSlot = (nextSlot + 1) % slots;
+    filled = std::min(filled + 1, historyLength);
+}
@@ -0,0 +1,36 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Maximum number of previous frames the temporal denoiser can keep
+const int maxDenoiseFrames = 16;
+
+// Motion-gated temporal denoiser over a fixed ring buffer of the previous (enhanced) frames, applied as a pass of its own
+// after the enhancement (whose transformations need the statistics of the whole frame first)
+class TemporalDenoiser
+{
+public:
+    // historyLength previous frames are kept; pixels differing by threshold (at most 255) or more from the current frame
+    // count as motion
+    TemporalDenoiser(const int historyLength, const double threshold);
+
+    // Denoises an enhanced BGR frame in place and stores it in the ring buffer, in parallel bands of rows without allocations
+    // (the ring buffer is only allocated for the first frame, or if the frame size changes). The frames are kept as planes,
+    // so the differences, weights and sums of each previous frame are whole-row OpenCV kernels (absdiff, max, subtract,
+    // accumulate), which run on SIMD; only the final division per pixel is scalar
+    void apply(cv::Mat& frame);
+
+    // Forgets the previous frames, e.g. after frames that were not denoised
+    void reset() { filled = 0; nextSlot = 0; }
+
+private:
+    int historyLength;
+    int threshold;
+    int filled = 0;
+    int nextSlot = 0;
+    std::vector<cv::Mat> history;       // historyLength + 1 slots: the previous frames and the current one, each row as B|G|R planes
+};
+
+#endif
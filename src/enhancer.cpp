@@ -0,0 +1,99 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include "utils.h"
+#include "denoise.h"
+#include "scheduler.h"
+#include "enhancer.h"
+
+Enhancer::Enhancer(const EnhancementSettings& settings)
+{
+    scratch.push_back(std::make_unique<TransformScratch>());
+    configure(settings);
+}
+
+Enhancer::~Enhancer() = default;
+
+void Enhancer::configure(const EnhancementSettings& settings)
+{
+    config = settings;
+    resetStream();
+}
+
+void Enhancer::resetStream()
+{
+    denoiser.reset();
+    if (config.denoiseFrames > 0)
+    {
+        denoiser = std::make_unique<TemporalDenoiser>(config.denoiseFrames, config.denoiseThreshold);
+    }
+}
+
+bool Enhancer::enhance(const cv::Mat& in, cv::Mat& out)
+{
+    return enhanceWith(in, out, *scratch[0]);
+}
+
+bool Enhancer::enhanceWith(const cv::Mat& in, cv::Mat& out, TransformScratch& buffers)
+{
+    if (in.empty() || in.type() != CV_8UC3)
+    {
+        std::cerr << "Error: Enhancer expects a non-empty 8-bit BGR image." << "\n";
+        return false;
+    }
+
+    // Work in the buffer of out, which keeps its allocation across calls of the same size
+    cv::Mat target = out;
+    target.create(in.size(), CV_8UC3);
+    if (target.data != in.data)
+    {
+        in.copyTo(target);
+    }
+
+    // Histograms are never plotted; transforms that allocate a new image are copied back
+    cv::Mat result = target;
+    enhanceFrame(result, config, "", false, false, "", "", &buffers);
+    if (result.data != target.data)
+    {
+        result.copyTo(target);
+    }
+    out = target;
+    return true;
+}
+
+bool Enhancer::enhanceBatch(const std::vector<cv::Mat>& in, std::vector<cv::Mat>& out)
+{
+    out.resize(in.size());
+    std::atomic<size_t> nextIndex(0);
+    std::atomic<bool> success(true);
+    const int workers = std::max(1, std::min(getThreadBudget().frameWorkers, static_cast<int>(in.size())));
+    while (static_cast<int>(scratch.size()) < workers)
+    {
+        scratch.push_back(std::make_unique<TransformScratch>());
+    }
+    runConcurrently(workers, [&](int worker)
+    {
+        for (size_t index = nextIndex++; index < in.size(); index = nextIndex++)
+        {
+            if (!enhanceWith(in[index], out[index], *scratch[worker]))
+            {
+                success = false;
+            }
+        }
+    });
+    return success;
+}
+
+bool Enhancer::enhanceNext(const cv::Mat& in, cv::Mat& out)
+{
+    if (!enhance(in, out))
+    {
+        return false;
+    }
+    if (denoiser)
+    {
+        denoiser->apply(out);
+    }
+    return true;
+}
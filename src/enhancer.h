@@ -0,0 +1,50 @@
+#ifndef ENHANCER_H
+#define ENHANCER_H
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <vector>
+#include "processor.h"
+
+class TemporalDenoiser;
+struct TransformScratch;
+
+// In-memory enhancement engine for embedding: configured once, it keeps its buffers (frame statistics, lookup tables, HSI images)
+// and state across calls and never touches the file system (no outputs, no histogram plots). Images/frames are 8-bit BGR at their
+// native resolution. An Enhancer serves one caller at a time; enhanceBatch gives each of its frame workers its own buffers.
+class Enhancer
+{
+public:
+    explicit Enhancer(const EnhancementSettings& settings = EnhancementSettings());
+    ~Enhancer();
+
+    Enhancer(const Enhancer&) = delete;
+    Enhancer& operator=(const Enhancer&) = delete;
+
+    // Replaces the settings and resets the stream state (the buffers are kept)
+    void configure(const EnhancementSettings& settings);
+    const EnhancementSettings& settings() const { return config; }
+
+    // Enhances a single image/frame; out may be in itself or a preallocated buffer of the same size, which is then written in place
+    // Returns false if the input is not an 8-bit BGR image
+    bool enhance(const cv::Mat& in, cv::Mat& out);
+
+    // Enhances independent images concurrently on the frame workers of the thread budget, returns false if any input is invalid
+    bool enhanceBatch(const std::vector<cv::Mat>& in, std::vector<cv::Mat>& out);
+
+    // Enhances the next frame of a stream, followed by temporal denoising over the previous frames if configured
+    bool enhanceNext(const cv::Mat& in, cv::Mat& out);
+
+    // Forgets the previous frames of the stream, e.g. at a scene cut or before the next stream
+    void resetStream();
+
+private:
+    // Enhances with the given set of buffers
+    bool enhanceWith(const cv::Mat& in, cv::Mat& out, TransformScratch& scratch);
+
+    EnhancementSettings config;
+    std::unique_ptr<TemporalDenoiser> denoiser;
+    std::vector<std::unique_ptr<TransformScratch>> scratch;   // buffers of the transforms, one set per frame worker
+};
+
+#endif
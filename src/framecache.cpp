@@ -0,0 +1,217 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "resultcache.h"
+#include "framecache.h"
+
+// Header of a cache entry, padded to 64 bytes so the frames start aligned
+struct FrameCacheHeader
+{
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t frameCount;
+    uint32_t reserved[11];
+};
+static_assert(sizeof(FrameCacheHeader) == 64, "The frame cache header must be 64 bytes");
+
+static const char frameCacheMagic[8] = {'D', 'V', 'Q', 'F', 'R', 'M', '0', '1'};
+
+std::string getFrameCacheDir(const std::string& rawVideoPath)
+{
+    return (std::filesystem::path(rawVideoPath).parent_path() / ".framecache").string();
+}
+
+DecodedFrameCache::DecodedFrameCache(const std::string& rawVideoPath, const cv::Size& frameSize, const int interpolation, const uint64_t maxBytes)
+    : cacheDir(getFrameCacheDir(rawVideoPath)), frameSize(frameSize), maxBytes(maxBytes)
+{
+    uint64_t contentHash = 0;
+    if (frameSize.area() <= 0 || !hashFileContent(rawVideoPath, contentHash))
+    {
+        return;
+    }
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << contentHash << std::dec << "_" << frameSize.width << "x" << frameSize.height << "_" << interpolation << ".frames";
+    entryPath = (std::filesystem::path(cacheDir) / name.str()).string();
+
+    if (!mapping.open(entryPath))
+    {
+        return;
+    }
+    FrameCacheHeader header;
+    const size_t frameBytes = static_cast<size_t>(frameSize.area()) * 3;
+    if (mapping.size() < sizeof(header))
+    {
+        mapping.close();
+        return;
+    }
+    std::memcpy(&header, mapping.data(), sizeof(header));
+    if (std::memcmp(header.magic, frameCacheMagic, sizeof(frameCacheMagic)) != 0
+        || static_cast<int>(header.width) != frameSize.width || static_cast<int>(header.height) != frameSize.height
+        || mapping.size() < sizeof(header) + header.frameCount * frameBytes)
+    {
+        mapping.close();
+        return;
+    }
+    frames = static_cast<int>(header.frameCount);
+
+    // Mark the entry as recently used for the eviction
+    std::error_code error;
+    std::filesystem::last_write_time(entryPath, std::filesystem::file_time_type::clock::now(), error);
+}
+
+DecodedFrameCache::~DecodedFrameCache()
+{
+    if (writing)
+    {
+        abortWrite();
+    }
+}
+
+cv::Mat DecodedFrameCache::frame(const int index) const
+{
+    if (index < 0 || index >= frames)
+    {
+        return cv::Mat();
+    }
+    const size_t frameBytes = static_cast<size_t>(frameSize.area()) * 3;
+    uchar* data = const_cast<uchar*>(mapping.data()) + sizeof(FrameCacheHeader) + index * frameBytes;
+    return cv::Mat(frameSize, CV_8UC3, data);
+}
+
+bool DecodedFrameCache::beginWrite(const int expectedFrames)
+{
+    if (entryPath.empty() || writing)
+    {
+        return false;
+    }
+
+    // Never start an entry that the size limit would evict right away
+    const uint64_t frameBytes = static_cast<uint64_t>(frameSize.area()) * 3;
+    if (sizeof(FrameCacheHeader) + static_cast<uint64_t>(std::max(expectedFrames, 1)) * frameBytes > maxBytes)
+    {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+
+    // A unique temporary name, so concurrent runs over the same video never write into each other's entry
+    tempPath = entryPath + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    output.open(tempPath, std::ios::binary | std::ios::trunc);
+    if (!output.is_open())
+    {
+        return false;
+    }
+    FrameCacheHeader header = {};
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writtenFrames = 0;
+    writing = true;
+    return true;
+}
+
+void DecodedFrameCache::append(const cv::Mat& frame)
+{
+    if (!writing)
+    {
+        return;
+    }
+    // Stop writing as soon as the entry outgrows the size limit (e.g. if the frame count was unknown), instead of filling the disk
+    const uint64_t frameBytes = static_cast<uint64_t>(frameSize.area()) * 3;
+    if (frame.size() != frameSize || frame.type() != CV_8UC3 || sizeof(FrameCacheHeader) + (writtenFrames + 1) * frameBytes > maxBytes)
+    {
+        abortWrite();
+        return;
+    }
+    for (int row = 0; row < frame.rows; ++row)
+    {
+        output.write(reinterpret_cast<const char*>(frame.ptr<uchar>(row)), static_cast<std::streamsize>(frame.cols) * 3);
+    }
+    writtenFrames++;
+}
+
+bool DecodedFrameCache::finishWrite()
+{
+    if (!writing)
+    {
+        return false;
+    }
+    if (writtenFrames == 0)
+    {
+        abortWrite();
+        return false;
+    }
+
+    // The frame count goes into the header last, then the entry is published under its final name in one step
+    FrameCacheHeader header = {};
+    std::memcpy(header.magic, frameCacheMagic, sizeof(frameCacheMagic));
+    header.width = static_cast<uint32_t>(frameSize.width);
+    header.height = static_cast<uint32_t>(frameSize.height);
+    header.frameCount = static_cast<uint32_t>(writtenFrames);
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.close();
+    writing = false;
+    if (!output)
+    {
+        abortWrite();
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, entryPath, error);
+    if (error)
+    {
+        std::cerr << "Error: Frame cache entry could not be saved: " << error.message() << "\n";
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    evict();
+    return true;
+}
+
+void DecodedFrameCache::abortWrite()
+{
+    if (output.is_open())
+    {
+        output.close();
+    }
+    writing = false;
+    std::error_code error;
+    std::filesystem::remove(tempPath, error);
+}
+
+void DecodedFrameCache::evict()
+{
+    // Remove the least recently used entries (by modification time, which reads refresh) until the directory fits its size limit
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+    uint64_t totalBytes = 0;
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(cacheDir, error))
+    {
+        if (file.path().extension() == ".frames")
+        {
+            totalBytes += file.file_size(error);
+            entries.emplace_back(file.last_write_time(error), file.path());
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    for (const auto& entry : entries)
+    {
+        if (totalBytes <= maxBytes)
+        {
+            break;
+        }
+        const uint64_t bytes = std::filesystem::file_size(entry.second, error);
+        if (std::filesystem::remove(entry.second, error))
+        {
+            totalBytes -= bytes;
+        }
+    }
+}
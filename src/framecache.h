@@ -0,0 +1,61 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "mappedinput.h"
+
+// Function to get the directory of the decoded-frame caches of the videos in a directory (next to the videos)
+std::string getFrameCacheDir(const std::string& rawVideoPath);
+
+// Decoded, fitted BGR frames of a video in one raw file, keyed by the content hash of the video and the frame size
+// The file is a fixed-size header followed by equally sized frames, so every frame is found at a computed offset
+// and read through a memory mapping without copying; entries are evicted least recently used beyond a size limit
+class DecodedFrameCache
+{
+public:
+    // Looks up the entry of a video for frames fitted to frameSize with the given interpolation in the cache directory next to it
+    // (maxBytes limits that directory)
+    DecodedFrameCache(const std::string& rawVideoPath, const cv::Size& frameSize, const int interpolation, const uint64_t maxBytes);
+    ~DecodedFrameCache();
+
+    DecodedFrameCache(const DecodedFrameCache&) = delete;
+    DecodedFrameCache& operator=(const DecodedFrameCache&) = delete;
+
+    // Returns true if a complete entry was found and mapped
+    bool isReadable() const { return frames > 0; }
+
+    int frameCount() const { return frames; }
+
+    // Read-only header over a mapped frame (no copy), valid as long as the cache is open
+    cv::Mat frame(const int index) const;
+
+    // Starts a new entry in a temporary file for expectedFrames frames (0 if unknown)
+    // Returns false if it could not be created or the expected entry would not fit the size limit
+    bool beginWrite(const int expectedFrames = 0);
+
+    // Appends the next frame; frames of another size or type, or frames beyond the size limit abort the entry
+    void append(const cv::Mat& frame);
+
+    // Completes the entry (only complete entries are ever read), evicts old entries and returns false if nothing was cached
+    bool finishWrite();
+
+private:
+    void abortWrite();
+    void evict();
+
+    std::string cacheDir;
+    std::string entryPath;
+    std::string tempPath;
+    cv::Size frameSize;
+    uint64_t maxBytes;
+    MappedFile mapping;
+    int frames = 0;
+    std::ofstream output;
+    int writtenFrames = 0;
+    bool writing = false;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <iostream>
+#include "frameselect.h"
+
+FrameSelector::FrameSelector(cv::VideoCapture& cap, const EnhancementSettings& settings, const DecodedFrameCache* cache)
+    : cap(cap), cache(cache)
+{
+    const double fps = cap.get(cv::CAP_PROP_FPS);
+    const int frameCount = (cache != nullptr) ? cache->frameCount() : static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+
+    // Times are converted to frame indices, so both kinds of ranges are seeked the same way
+    first = std::max(0, settings.startFrame);
+    if (settings.startTime >= 0.0 && fps > 0.0)
+    {
+        first = cvRound(settings.startTime * fps);
+    }
+    last = settings.endFrame;
+    if (settings.endTime >= 0.0 && fps > 0.0)
+    {
+        last = cvRound(settings.endTime * fps);
+    }
+    if (frameCount > 0)
+    {
+        last = (last < 0) ? frameCount : std::min(last, frameCount);
+    }
+    step = std::max(1, settings.frameStep);
+    if (fps > 0.0)
+    {
+        seekThreshold = std::max(seekThreshold, cvRound(2 * fps));
+    }
+
+    if (settings.sampleFrames > 0)
+    {
+        if (last > first)
+        {
+            // The centers of equally long sections of the range
+            const int count = std::min(settings.sampleFrames, last - first);
+            for (int i = 0; i < count; ++i)
+            {
+                samples.push_back(first + static_cast<int>((2LL * i + 1) * (last - first) / (2LL * count)));
+            }
+        }
+        else
+        {
+            std::cerr << "Warning: The frame count of the video is unknown, so every " << step << ". frame is read instead of evenly spaced samples.\n";
+        }
+    }
+
+    // The end of the range is clamped to the frame count above, so only an explicitly given end makes the selection partial
+    partial = (first > 0 || settings.endFrame >= 0 || settings.endTime >= 0.0 || !isContiguous());
+
+    next = first;
+    if (first > 0 && cache == nullptr)
+    {
+        cap.set(cv::CAP_PROP_POS_FRAMES, first);
+        position = first;
+    }
+}
+
+bool FrameSelector::skipTo(const int target)
+{
+    if (target - position > seekThreshold)
+    {
+        // Seeking decodes from the preceding key frame, which is cheaper than decoding the whole gap
+        cap.set(cv::CAP_PROP_POS_FRAMES, target);
+        position = target;
+        return true;
+    }
+    while (position < target)
+    {
+        if (!cap.grab())
+        {
+            return false;
+        }
+        position++;
+    }
+    return true;
+}
+
+bool FrameSelector::read(cv::Mat& frame, int& frameIndex)
+{
+    int target;
+    if (!samples.empty())
+    {
+        if (sampleIndex >= samples.size())
+        {
+            return false;
+        }
+        target = samples[sampleIndex++];
+    }
+    else
+    {
+        target = next;
+        next += step;
+    }
+    if (last >= 0 && target >= last)
+    {
+        return false;
+    }
+
+    if (cache != nullptr)
+    {
+        // Any frame of the cache is found at once, so there is nothing to skip
+        frame = cache->frame(target);
+        frameIndex = target;
+        return !frame.empty();
+    }
+
+    if (!skipTo(target) || !cap.read(frame) || frame.empty())
+    {
+        return false;
+    }
+    position++;
+    frameIndex = target;
+    return true;
+}
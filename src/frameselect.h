@@ -0,0 +1,43 @@
+#ifndef FRAME_SELECT_H
+#define FRAME_SELECT_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "processor.h"
+#include "framecache.h"
+
+// Reads only the frames of a video selected by the settings: a frame or time range, every n-th frame or a number of evenly spaced frames
+// Frames up to a few seconds ahead are skipped with grab() (no conversion), larger gaps are seeked over
+// With a readable decoded-frame cache, the frames are taken from it instead of being decoded
+class FrameSelector
+{
+public:
+    FrameSelector(cv::VideoCapture& cap, const EnhancementSettings& settings, const DecodedFrameCache* cache = nullptr);
+
+    // Reads the next selected frame and its index in the video, returns false at the end of the selection
+    // (frames from the cache are read-only headers over its mapping)
+    bool read(cv::Mat& frame, int& frameIndex);
+
+    // Returns true if every frame of the range is read, so consecutive frames are neighbours in time
+    bool isContiguous() const { return step == 1 && samples.empty(); }
+
+    // Returns true if only part of the video is processed
+    bool isPartial() const { return partial; }
+
+private:
+    bool skipTo(const int target);
+
+    cv::VideoCapture& cap;
+    const DecodedFrameCache* cache;
+    int first = 0;
+    int last = -1;
+    int step = 1;
+    int next = 0;
+    int position = 0;
+    int seekThreshold = 48;
+    bool partial = false;
+    std::vector<int> samples;
+    size_t sampleIndex = 0;
+};
+
+#endif
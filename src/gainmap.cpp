@@ -0,0 +1,241 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "utils.h"
+#include "gainmap.h"
+
+// Function to build the CLAHE lookup tables of every tile and channel of a BGR frame from every step-th pixel of the tile
+// (same tiles, clipping, redistribution and scaling as cv::CLAHE, whose tiles cover the frame padded by reflection to a multiple
+// of the grid); tileLUTs holds one row per tile with the 256 values of each channel
+static void computeSampledTileLUTs(const cv::Mat& frame, const cv::Size& tileGrid, const cv::Size& tileSize, const double clipLimit, const int step, cv::Mat& tileLUTs)
+{
+    const int histSize = 256;
+    tileLUTs.create(tileGrid.area(), 3 * histSize, CV_8U);
+
+    cv::parallel_for_(cv::Range(0, tileGrid.area()), [&](const cv::Range& range)
+    {
+        std::vector<int> hists(3 * histSize);
+        for (int tile = range.start; tile < range.end; ++tile)
+        {
+            const int tx = tile % tileGrid.width;
+            const int ty = tile / tileGrid.width;
+            std::fill(hists.begin(), hists.end(), 0);
+            int samples = 0;
+            for (int y = std::min(step / 2, tileSize.height - 1); y < tileSize.height; y += step)
+            {
+                const cv::Vec3b* row = frame.ptr<cv::Vec3b>(cv::borderInterpolate(ty * tileSize.height + y, frame.rows, cv::BORDER_REFLECT_101));
+                for (int x = std::min(step / 2, tileSize.width - 1); x < tileSize.width; x += step)
+                {
+                    const cv::Vec3b& pixel = row[cv::borderInterpolate(tx * tileSize.width + x, frame.cols, cv::BORDER_REFLECT_101)];
+                    hists[pixel[0]]++;
+                    hists[histSize + pixel[1]]++;
+                    hists[2 * histSize + pixel[2]]++;
+                    samples++;
+                }
+            }
+
+            // The clip limit is relative to the sampled pixels, as it is to the tile area in cv::CLAHE
+            const int clip = (clipLimit > 0.0) ? std::max(static_cast<int>(clipLimit * samples / histSize), 1) : 0;
+            const float lutScale = static_cast<float>(histSize - 1) / samples;
+            uchar* lut = tileLUTs.ptr<uchar>(tile);
+            for (int c = 0; c < 3; ++c)
+            {
+                int* hist = &hists[c * histSize];
+                if (clip > 0)
+                {
+                    // Clip the histogram and redistribute the clipped counts evenly, the remainder in steps over the bins
+                    int clipped = 0;
+                    for (int i = 0; i < histSize; ++i)
+                    {
+                        if (hist[i] > clip)
+                        {
+                            clipped += hist[i] - clip;
+                            hist[i] = clip;
+                        }
+                    }
+                    const int redistBatch = clipped / histSize;
+                    int residual = clipped - redistBatch * histSize;
+                    for (int i = 0; i < histSize; ++i)
+                    {
+                        hist[i] += redistBatch;
+                    }
+                    if (residual != 0)
+                    {
+                        const int residualStep = std::max(histSize / residual, 1);
+                        for (int i = 0; i < histSize && residual > 0; i += residualStep, residual--)
+                        {
+                            hist[i]++;
+                        }
+                    }
+                }
+
+                int sum = 0;
+                for (int i = 0; i < histSize; ++i)
+                {
+                    sum += hist[i];
+                    lut[c * histSize + i] = cv::saturate_cast<uchar>(sum * lutScale);
+                }
+            }
+        }
+    });
+}
+
+// Function to map every pixel through the lookup tables of the four nearest tiles, interpolated bilinearly like cv::CLAHE
+static void applyTileLUTs(cv::Mat& frame, const cv::Mat& tileLUTs, const cv::Size& tileGrid, const cv::Size& tileSize)
+{
+    const int histSize = 256;
+    const int lutStep = 3 * histSize;
+    const float invTileWidth = 1.0f / tileSize.width;
+    const float invTileHeight = 1.0f / tileSize.height;
+
+    // The horizontal tiles and weights are the same for every row
+    std::vector<int> left(frame.cols), right(frame.cols);
+    std::vector<float> rightWeight(frame.cols);
+    for (int x = 0; x < frame.cols; ++x)
+    {
+        const float txf = x * invTileWidth - 0.5f;
+        const int tx1 = cvFloor(txf);
+        rightWeight[x] = txf - tx1;
+        left[x] = std::max(tx1, 0) * lutStep;
+        right[x] = std::min(tx1 + 1, tileGrid.width - 1) * lutStep;
+    }
+
+    cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& range)
+    {
+        for (int y = range.start; y < range.end; ++y)
+        {
+            const float tyf = y * invTileHeight - 0.5f;
+            const int ty1 = cvFloor(tyf);
+            const float bottomWeight = tyf - ty1;
+            const uchar* top = tileLUTs.ptr<uchar>(std::max(ty1, 0) * tileGrid.width);
+            const uchar* bottom = tileLUTs.ptr<uchar>(std::min(ty1 + 1, tileGrid.height - 1) * tileGrid.width);
+
+            cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < frame.cols; ++x)
+            {
+                const float xa = rightWeight[x];
+                for (int c = 0; c < 3; ++c)
+                {
+                    const int value = c * histSize + row[x][c];
+                    const float topValue = top[left[x] + value] * (1.0f - xa) + top[right[x] + value] * xa;
+                    const float bottomValue = bottom[left[x] + value] * (1.0f - xa) + bottom[right[x] + value] * xa;
+                    row[x][c] = cv::saturate_cast<uchar>(topValue * (1.0f - bottomWeight) + bottomValue * bottomWeight);
+                }
+            }
+        }
+    });
+}
+
+// Function to enhance the frame with CLAHE on every channel, as transformHistEqual, but with the tile histograms sampled at
+// every step-th pixel (the mapping is still applied to every pixel, so the fine detail of the frame is kept)
+static void enhanceLocalHistEqualGainMap(cv::Mat& frame, const EnhancementSettings& settings, const int step, cv::Mat& tileLUTs)
+{
+    const cv::Size tileGrid = settings.tileGridSize;
+    const cv::Size tileSize((frame.cols + tileGrid.width - 1) / tileGrid.width, (frame.rows + tileGrid.height - 1) / tileGrid.height);
+    computeSampledTileLUTs(frame, tileGrid, tileSize, settings.clipLimit, step, tileLUTs);
+    applyTileLUTs(frame, tileLUTs, tileGrid, tileSize);
+}
+
+// Function to enhance the frame with the AGCWHD gamma function, estimated from a sparse sample of the intensity histogram
+// (AGCWHD is a global mapping of the intensity, so the gain of every pixel follows directly from its own intensity)
+static void enhanceAGCWHDGainMap(cv::Mat& frame, const EnhancementSettings& settings, const int step, const std::string& fileName,
+    const bool plotHistograms, const bool verbose, const std::string& histDir, const std::string& file)
+{
+    const int maxL = settings.L - 1;
+    const double invMaxLim = 1.0 / maxL;
+
+    // Same quantization as the intensity in transformBGRToHSI
+    const auto intensityCode = [maxL, invMaxLim](const cv::Vec3b& pixel)
+    {
+        const double BGRsum = pixel[0] * invMaxLim + pixel[1] * invMaxLim + pixel[2] * invMaxLim;
+        return static_cast<int>(static_cast<uchar>(BGRsum / 3.0 * maxL));
+    };
+
+    std::vector<int> intensityHist(std::max(settings.L, 256), 0);
+    for (int y = step / 2; y < frame.rows; y += step)
+    {
+        const cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+        for (int x = step / 2; x < frame.cols; x += step)
+        {
+            intensityHist[intensityCode(row[x])]++;
+        }
+    }
+
+    std::map<double, int> channelHist;
+    double cMax = 0.0;
+    for (int value = 0; value < static_cast<int>(intensityHist.size()); ++value)
+    {
+        if (value < settings.L || intensityHist[value] > 0)
+        {
+            channelHist[value] = intensityHist[value];
+        }
+        if (intensityHist[value] > 0)
+        {
+            cMax = value;
+        }
+    }
+    const cv::Mat gammaLut = computeGammaLUT(computeAGCWHDGamma(channelHist, settings.L, cMax, verbose), cMax);
+    const uchar* lut = gammaLut.ptr<uchar>(0);
+
+    // The histograms are plotted from the sample, scaled to the pixel count of the whole frame
+    if (plotHistograms && !histDir.empty() && !file.empty())
+    {
+        std::map<double, int> frameHist = channelHist;
+        for (auto& bin : frameHist)
+        {
+            bin.second *= step * step;
+        }
+        plotAGCWHDHistograms(frameHist, gammaLut, settings.L, fileName, histDir, file, verbose);
+    }
+
+    // Per-intensity gain, so the full-resolution pass is a lookup and three multiplications per pixel
+    std::vector<float> gains(256, 1.0f);
+    for (int value = 1; value < 256; ++value)
+    {
+        gains[value] = static_cast<float>(lut[value]) / value;
+    }
+
+    cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& range)
+    {
+        for (int y = range.start; y < range.end; ++y)
+        {
+            cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < frame.cols; ++x)
+            {
+                const int code = intensityCode(row[x]);
+                if (code == 0)
+                {
+                    row[x] = cv::Vec3b(lut[0], lut[0], lut[0]);
+                    continue;
+                }
+                for (int c = 0; c < 3; ++c)
+                {
+                    row[x][c] = cv::saturate_cast<uchar>(row[x][c] * gains[code]);
+                }
+            }
+        }
+    });
+}
+
+void enhanceFrameGainMap(
+    cv::Mat& frame, const EnhancementSettings& settings, const std::string& fileName, const bool plotHistograms,
+    const bool verbose, const std::string& histDir, const std::string& file, TransformScratch* scratch)
+{
+    const int scale = std::max(1, settings.gainMapScale);
+
+    if (settings.transformType == "locHE")
+    {
+        // Without buffers of the caller, the tile lookup tables only live for this call
+        cv::Mat localTileLUTs;
+        enhanceLocalHistEqualGainMap(frame, settings, scale, (scratch != nullptr) ? scratch->tileLUTs : localTileLUTs);
+    }
+    else if (settings.transformType == "AGCWHD")
+    {
+        enhanceAGCWHDGainMap(frame, settings, scale, fileName, plotHistograms, verbose, histDir, file);
+    }
+    else
+    {
+        std::cerr << "Error: The gain map only supports the 'locHE' and 'AGCWHD' transform types.\n";
+    }
+}
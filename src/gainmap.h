@@ -0,0 +1,15 @@
+#ifndef GAIN_MAP_H
+#define GAIN_MAP_H
+
+#include <opencv2/opencv.hpp>
+#include "processor.h"
+
+// Function to estimate the locHE/AGCWHD enhancement of a stretched frame from every n-th pixel (n = gainMapScale) in both
+// directions and apply it to every pixel: for locHE, the CLAHE lookup table of every tile and channel is built from the sampled
+// tile histograms and interpolated between tiles like cv::CLAHE; for AGCWHD, the gamma function of the sampled intensity
+// histogram is applied as a per-intensity gain (the histogram plotting and scratch parameters are those of enhanceFrame)
+void enhanceFrameGainMap(
+    cv::Mat& frame, const EnhancementSettings& settings, const std::string& fileName = "", const bool plotHistograms = false,
+    const bool verbose = false, const std::string& histDir = "", const std::string& file = "", TransformScratch* scratch = nullptr);
+
+#endif
@@ -0,0 +1,126 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include "ladder.h"
+#include "scheduler.h"
+
+bool parseRenditions(const std::string& renditions, std::vector<int>& heights)
+{
+    heights.clear();
+    std::istringstream list(renditions);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+        const int height = std::stoi(item);
+        if (height <= 0)
+        {
+            return false;
+        }
+        heights.push_back(height);
+    }
+    std::sort(heights.begin(), heights.end(), std::greater<int>());
+    heights.erase(std::unique(heights.begin(), heights.end()), heights.end());
+    return !heights.empty();
+}
+
+cv::Size fitFrameSize(const cv::Size& frameSize, int windowMaxWidth, int windowMaxHeight)
+{
+    // Same scaling factor and rounding as fitImageToWindow
+    const double scaleFactor = std::min(static_cast<double>(windowMaxWidth) / frameSize.width, static_cast<double>(windowMaxHeight) / frameSize.height);
+    if (scaleFactor >= 1.0)
+    {
+        return frameSize;
+    }
+    return cv::Size(cvRound(frameSize.width * scaleFactor), cvRound(frameSize.height * scaleFactor));
+}
+
+RenditionLadder::RenditionLadder(const std::string& outputDir, const std::string& fileName, const cv::Size& frameSize, const double fps, const std::vector<int>& heights)
+{
+    std::vector<int> usedHeights;
+    for (const int height : heights)
+    {
+        if (height <= frameSize.height)
+        {
+            usedHeights.push_back(height);
+        }
+        else
+        {
+            std::cerr << "Warning: Rendition " << height << "p is higher than the video (" << frameSize.height << "p) and is skipped.\n";
+        }
+    }
+    if (usedHeights.empty())
+    {
+        usedHeights.push_back(frameSize.height);
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(outputDir, error);
+
+    // Writers close their stream when destroyed, so they must never be moved by a reallocation
+    writers.reserve(usedHeights.size());
+    for (const int height : usedHeights)
+    {
+        // Even dimensions, as most encoders subsample the chroma
+        const int width = cvRound(static_cast<double>(frameSize.width) * height / frameSize.height);
+        sizes.emplace_back(std::max(2, width & ~1), std::max(2, height & ~1));
+        paths.push_back((std::filesystem::path(outputDir) / (fileName + "_" + std::to_string(height) + "p.mp4")).string());
+        writers.emplace_back(paths.back(), cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, sizes.back());
+    }
+    buffers.resize(sizes.size());
+}
+
+bool RenditionLadder::isOpened() const
+{
+    return std::all_of(writers.begin(), writers.end(), [](const cv::VideoWriter& writer) { return writer.isOpened(); });
+}
+
+void RenditionLadder::write(const std::vector<cv::Mat>& frames, const int count)
+{
+    const auto writeRendition = [&](int rendition)
+    {
+        for (int index = 0; index < count; ++index)
+        {
+            // The top rendition is written as enhanced, the others are resized from it into a reused buffer
+            if (frames[index].size() == sizes[rendition])
+            {
+                writers[rendition].write(frames[index]);
+            }
+            else
+            {
+                cv::resize(frames[index], buffers[rendition], sizes[rendition], 0, 0, cv::INTER_AREA);
+                writers[rendition].write(buffers[rendition]);
+            }
+        }
+    };
+    if (writers.size() == 1)
+    {
+        writeRendition(0);
+    }
+    else
+    {
+        runConcurrently(static_cast<int>(writers.size()), writeRendition);
+    }
+}
+
+void RenditionLadder::release()
+{
+    for (cv::VideoWriter& writer : writers)
+    {
+        writer.release();
+    }
+}
+
+void RenditionLadder::printRenditions() const
+{
+    for (size_t rendition = 0; rendition < paths.size(); ++rendition)
+    {
+        std::cout << "Rendition " << sizes[rendition].width << "x" << sizes[rendition].height << " saved under: " << paths[rendition] << "\n";
+    }
+}
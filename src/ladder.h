@@ -0,0 +1,45 @@
+#ifndef LADDER_H
+#define LADDER_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Function to parse a comma-separated list of rendition heights (e.g. "1080,720,480") into distinct heights sorted from the highest
+// Returns false if the list is empty or contains anything but positive numbers
+bool parseRenditions(const std::string& renditions, std::vector<int>& heights);
+
+// Function to get the size fitImageToWindow resizes a frame of the given size to, without resizing anything
+cv::Size fitFrameSize(const cv::Size& frameSize, int windowMaxWidth, int windowMaxHeight);
+
+// Encoders writing one enhanced stream at several resolutions (an output ladder), so a video is decoded and enhanced only once
+class RenditionLadder
+{
+public:
+    // Opens one mp4 writer per height, named <fileName>_<height>p.mp4 in outputDir; heights above the frame height are dropped
+    // (frames are never upscaled), and the frame height itself is used if none is left
+    RenditionLadder(const std::string& outputDir, const std::string& fileName, const cv::Size& frameSize, const double fps, const std::vector<int>& heights);
+
+    // Returns true if every writer could be opened
+    bool isOpened() const;
+
+    // Size of the highest rendition, at which the frames are enhanced
+    cv::Size topSize() const { return sizes.front(); }
+
+    // Writes frames[0] ... frames[count - 1] (at the top size) to every rendition, in one resize pass per rendition
+    // and with the renditions resized and encoded concurrently
+    void write(const std::vector<cv::Mat>& frames, const int count);
+
+    void release();
+
+    // Prints the path and size of every rendition
+    void printRenditions() const;
+
+private:
+    std::vector<cv::Size> sizes;
+    std::vector<std::string> paths;
+    std::vector<cv::VideoWriter> writers;
+    std::vector<cv::Mat> buffers;
+};
+
+#endif
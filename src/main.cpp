@@ -5,6 +5,15 @@
 #include <filesystem>
 #include "utils.h"
 #include "processor.h"
+#include "manifest.h"
+#include "daemon.h"
+#include "resultcache.h"
+#include "denoise.h"
+#include "scheduler.h"
+#include "perfcounters.h"
+#include "ladder.h"
+#include "regression.h"
+#include <memory>
 #include "ReadImageQt.h"
 
 void printUsage(const char* programName)
@@ -15,14 +24,50 @@ void printUsage(const char* programName)
     << "<rawFileDir>          ----    <char>    Enter directory of the raw file\n"
     << "<rawFileName>         ----    <char>    Enter name of the raw file\n"
     << "<rawFileType>         ----    <char>    Enter type of the raw file\n"
-    << "<transformType>       ----    <char>    Choose transform type: 'log', 'locHE', 'globHE', 'AGCWHD'\n"
+    << "<transformType>       ----    <char>    Choose transform type: 'log', 'locHE', 'globHE', 'AGCWHD', 'auto' (cheapest one predicted to be good enough, per image/frame)\n"
     << "<L>                   ----    <int>     Enter the number of possible intensity values\n"
     << "<verbose>             ----    <bool>    Show extended commentary: 'true', 'false'\n"
     << "[<show>]              ----    <bool>    Show output image (only for 'image' mode): 'true', 'false'\n"
-    << "[<inputScale>]        ----    <double>  Enter the input scale (only for 'log' transform type)\n"
-    << "[<clipLimit>]         ----    <double>  Enter the clip limit (only for 'locHE' transform type)\n"
-    << "[<tileGridWidth>]     ----    <int>     Enter the tile grid width (only for 'locHE' transform type)\n"
-    << "[<tileGridHeight>]    ----    <int>     Enter the tile grid height (only for 'locHE' transform type)\n";
+    << "[<inputScale>]        ----    <double>  Enter the input scale (only for 'log' and 'auto' transform types)\n"
+    << "[<clipLimit>]         ----    <double>  Enter the clip limit (only for 'locHE' and 'auto' transform types)\n"
+    << "[<tileGridWidth>]     ----    <int>     Enter the tile grid width (only for 'locHE' and 'auto' transform types)\n"
+    << "[<tileGridHeight>]    ----    <int>     Enter the tile grid height (only for 'locHE' and 'auto' transform types)\n"
+    << "[<fastMath>]          ----    <bool>    Use the fast HSI conversions, within 1 LSB of the exact ones (only for 'AGCWHD' and 'auto' transform types): 'true', 'false'\n"
+    << "[<gainMapScale>]      ----    <int>     Enter a downsampling factor to estimate the enhancement as a gain map (only for 'locHE', 'AGCWHD' and 'auto' transform types, 1 disables it)\n"
+    << "[<autoQuality>]       ----    <double>  Enter the predicted quality (0 - 1) the chosen transform has to reach (only for 'auto' transform type, default 0.8)\n"
+    << "[<autoTargetFps>]     ----    <double>  Enter a throughput target in frames per second the chosen transform has to fit (only for 'auto' transform type)\n"
+    << "[<tileSkipSize>]      ----    <int>     Enter a tile size to only enhance dark tiles and pass bright ones through (0 disables it)\n"
+    << "[<tileSkipThreshold>] ----    <double>  Enter the mean intensity from which a tile counts as bright (default 100)\n"
+    << "[<passThroughThreshold>] -- <double>  Enter the mean intensity from which well-exposed frames are written unchanged (only for 'video' mode, 0 disables it)\n"
+    << "[<passThroughHysteresis>] -- <double>  Enter the width of the band around the pass-through threshold that keeps the previous decision (default 10)\n"
+    << "[<denoiseFrames>]     ----    <int>     Enter the number of previous frames for temporal denoising (only for 'video' mode, 0 disables it, max 16)\n"
+    << "[<denoiseThreshold>]  ----    <double>  Enter the pixel difference from which temporal denoising treats a pixel as moving (default 20)\n"
+    << "[<yuvOutput>]         ----    <char>    Enhance the luma of native YUV frames (only for 'video' mode): 'y4m' (no color conversion), 'mp4' (one conversion)\n"
+    << "[<startFrame>]        ----    <int>     Enter the first frame to process (only for 'video' mode)\n"
+    << "[<endFrame>]          ----    <int>     Enter the frame after the last one to process (only for 'video' mode)\n"
+    << "[<startTime>]         ----    <double>  Enter the start of the time range to process in seconds (only for 'video' mode)\n"
+    << "[<endTime>]           ----    <double>  Enter the end of the time range to process in seconds (only for 'video' mode)\n"
+    << "[<frameStep>]         ----    <int>     Process only every n-th frame (only for 'video' mode)\n"
+    << "[<sampleFrames>]      ----    <int>     Process only this many evenly spaced frames (only for 'video' mode)\n"
+    << "[<previewOutput>]     ----    <char>    Save the processed frames as: 'clip', 'stills' (only for 'video' mode)\n"
+    << "[<frameCacheMaxMB>]   ----    <int>     Enter a size limit in MB to cache the decoded frames next to the video for later runs (only for 'video' mode, 0 disables it)\n"
+    << "[<renditions>]        ----    <char>    Enter comma-separated output heights, e.g. '1080,720,480', decoded and enhanced once (only for 'video' mode)\n"
+    << "[<threads>]           ----    <int>     Enter the total thread budget (default: number of cores)\n"
+    << "[<frameWorkers>]      ----    <int>     Enter the number of frames enhanced concurrently (only for 'video' mode, default 1)\n"
+    << "[<pinThreads>]        ----    <bool>    Pin the frame workers to disjoint sets of cores (Linux only): 'true', 'false'\n"
+    << "[<profile>]           ----    <bool>    Count cycles, instructions, cache and branch misses per stage (Linux perf events, single-threaded): 'true', 'false'\n"
+    << "[<trackAllocations>]  ----    <bool>    Count allocations, allocated bytes and resident memory per stage and frame: 'true', 'false'\n"
+    << "[<cacheDir>]          ----    <char>    Enter a directory to cache results in, unchanged inputs are then not reprocessed\n"
+    << "[<cacheMaxMB>]        ----    <int>     Enter the maximum size of the result cache in MB (default 1024)\n"
+    << "\n" << "Alternatively, run many jobs from a JSON/YAML manifest in one process:\n"
+    << "manifest <manifestPath> <resultsPath> [<verbose>]\n"
+    << "\n" << "Or measure the throughput of a manifest for every split of the thread budget:\n"
+    << "benchmark <manifestPath> [<threads>] [<repeat>]\n"
+    << "\n" << "Or check the outputs and the throughput of every transform type against stored golden images and a baseline:\n"
+    << "regress <rawImageDir> <goldenDir> [<update>] [<allowedRegression>]\n"
+    << "\n" << "Or serve requests on a Unix domain socket and send requests to it:\n"
+    << "daemon <socketPath> [<workerCount>] [<verbose>]\n"
+    << "client <socketPath> <requestJson> [<repeat>]\n";
 }
 
 int main (int argc, char *argv[])
@@ -40,10 +85,76 @@ int main (int argc, char *argv[])
         return -1;
     }
 
+    // Run all jobs of a manifest in this process
+    if (std::string(argv[1]) == "manifest")
+    {
+        if (argc < 4)
+        {
+            std::cerr << "Error: 'manifest' mode requires a manifest path and a results path." << "\n";
+            printUsage(argv[0]);
+            return -1;
+        }
+        const bool manifestVerbose = (argc > 4 && std::string(argv[4]) == "true");
+        return runManifest(argv[2], argv[3], manifestVerbose);
+    }
+
+    // Measure the throughput of a manifest's jobs for every split of the thread budget
+    if (std::string(argv[1]) == "benchmark")
+    {
+        if (argc < 3)
+        {
+            std::cerr << "Error: 'benchmark' mode requires a manifest path." << "\n";
+            printUsage(argv[0]);
+            return -1;
+        }
+        const int totalThreads = (argc > 3) ? std::stoi(argv[3]) : 0;
+        const int repeat = (argc > 4) ? std::stoi(argv[4]) : 1;
+        return runThreadBenchmark(argv[2], totalThreads, repeat);
+    }
+
+    // Compare the outputs and the throughput of every transform type with the golden images and the baseline
+    if (std::string(argv[1]) == "regress")
+    {
+        if (argc < 4)
+        {
+            std::cerr << "Error: 'regress' mode requires a raw image directory and a golden directory." << "\n";
+            printUsage(argv[0]);
+            return -1;
+        }
+        const bool update = (argc > 4 && std::string(argv[4]) == "true");
+        const double allowedRegression = (argc > 5) ? std::stod(argv[5]) : 0.1;
+        return runRegressionSuite(argv[2], argv[3], update, allowedRegression);
+    }
+
+    // Serve enhancement requests as a persistent daemon, or send requests to it
+    if (std::string(argv[1]) == "daemon")
+    {
+        if (argc < 3)
+        {
+            std::cerr << "Error: 'daemon' mode requires a socket path." << "\n";
+            printUsage(argv[0]);
+            return -1;
+        }
+        const int workerCount = (argc > 3) ? std::stoi(argv[3]) : 4;
+        const bool daemonVerbose = (argc > 4 && std::string(argv[4]) == "true");
+        return runDaemon(argv[2], workerCount, daemonVerbose);
+    }
+    if (std::string(argv[1]) == "client")
+    {
+        if (argc < 4)
+        {
+            std::cerr << "Error: 'client' mode requires a socket path and a request." << "\n";
+            printUsage(argv[0]);
+            return -1;
+        }
+        const int repeat = (argc > 4) ? std::stoi(argv[4]) : 1;
+        return runClient(argv[2], argv[3], repeat);
+    }
+
     // Check if the mandatory arguments are provided and do not start with '-'
     for (int i = 1; i <= 7; ++i) 
     {
-        if (argv[i] == nullptr || argv[i][0] == '-') 
+        if (i >= argc || argv[i][0] == '-') 
         {
             std::cerr << "Error: Argument " << i << " is required but not provided." << "\n";
             printUsage(argv[0]);
@@ -56,15 +167,41 @@ int main (int argc, char *argv[])
     const std::string rawFileDir = argv[2];                         // Directory of raw file
     const std::string rawFileName = argv[3];                        // Name of raw file
     const std::string rawFileType = argv[4];                        // Type of raw file
-    const std::string transformType = argv[5];                      // Transform type: "log", "locHE", "globHE" or "AGCWHD"
+    const std::string transformType = argv[5];                      // Transform type: "log", "locHE", "globHE", "AGCWHD" or "auto"
     const int L = std::stoi(argv[6]);                               // Number of possible intensity values
     const bool verbose = (std::string(argv[7]) == "true");          // Show extended commentary
+    const bool autoTransform = (transformType == "auto");           // Choose the transform type per image/frame
 
     // Initialize optional parameters with defaults
     bool show = false;                                              // Show output image (only for "image" mode)
     double inputScale = 1.0;                                        // input scale (only for logarithmic transformation)
     double clipLimit = 0.0;                                         // clip limit (only for local histogram equalization)
     cv::Size tileGridSize(8, 8);                                    // tile grid size (only for local histogram equalization)
+    bool fastMath = false;                                          // fast-math HSI conversions (only for AGCWHD)
+    int gainMapScale = 1;                                           // downsampling factor of the gain map (only for locHE and AGCWHD)
+    double autoQuality = 0.8;                                       // predicted quality the chosen transform has to reach (only for auto)
+    double autoTargetFps = 0.0;                                     // throughput target in frames per second (only for auto, disabled if 0)
+    int tileSkipSize = 0;                                           // tile size for dark-region tile skipping (disabled if 0)
+    double tileSkipThreshold = 100.0;                               // mean intensity from which a tile counts as bright
+    double passThroughThreshold = 0.0;                              // mean intensity from which frames are passed through (only for "video" mode)
+    double passThroughHysteresis = 10.0;                            // band around the pass-through threshold that keeps the previous decision
+    int denoiseFrames = 0;                                          // previous frames for temporal denoising (only for "video" mode)
+    double denoiseThreshold = 20.0;                                 // pixel difference from which denoising treats a pixel as moving
+    std::string yuvOutput;                                          // native YUV video path (only for "video" mode)
+    int startFrame = 0;                                             // first processed frame (only for "video" mode)
+    int endFrame = -1;                                              // frame after the last processed one (-1 = until the end)
+    double startTime = -1.0;                                        // start of the processed time range in seconds (overrides startFrame)
+    double endTime = -1.0;                                          // end of the processed time range in seconds (overrides endFrame)
+    int frameStep = 1;                                              // process every n-th frame
+    int sampleFrames = 0;                                           // evenly spaced frames of the range to process (disabled if 0)
+    std::string previewOutput = "clip";                             // output of the selected frames: "clip" or "stills"
+    int frameCacheMaxMB = 0;                                        // size limit of the decoded-frame cache (disabled if 0)
+    std::string renditions;                                         // comma-separated output heights (one output if empty)
+    ThreadBudget budget;                                            // split of the thread budget
+    bool profile = false;                                           // profile the stages with hardware counters
+    bool trackAllocations = false;                                  // track allocations and resident memory per stage
+    std::string cacheDir;                                           // result cache directory (disabled if empty)
+    int cacheMaxMB = 1024;                                          // maximum size of the result cache in MB
 
     // Initialize optional parameter flags with defaults
     bool showProvided = false;
@@ -92,7 +229,7 @@ int main (int argc, char *argv[])
             return -1;
             }
         }
-        else if (arg == "--inputScale" && transformType == "log")
+        else if (arg == "--inputScale" && (transformType == "log" || autoTransform))
         {
             if (i + 1 < argc && argv[i + 1][0] != '-')
             {
@@ -105,7 +242,7 @@ int main (int argc, char *argv[])
                 return -1;
             }
         }
-        else if (arg == "--clipLimit" && transformType == "locHE")
+        else if (arg == "--clipLimit" && (transformType == "locHE" || autoTransform))
         {
             if (i + 1 < argc && argv[i + 1][0] != '-')
             {
@@ -118,7 +255,7 @@ int main (int argc, char *argv[])
                 return -1;
             }
         }
-        else if (arg == "--tileGridWidth" && transformType == "locHE")
+        else if (arg == "--tileGridWidth" && (transformType == "locHE" || autoTransform))
         {
             if (i + 1 < argc && argv[i + 1][0] != '-')
             {
@@ -131,7 +268,7 @@ int main (int argc, char *argv[])
                 return -1;
             }
         }
-        else if (arg == "--tileGridHeight" && transformType == "locHE")
+        else if (arg == "--tileGridHeight" && (transformType == "locHE" || autoTransform))
         {
             if (i + 1 < argc && argv[i + 1][0] != '-')
             {
@@ -144,6 +281,330 @@ int main (int argc, char *argv[])
                 return -1;
             }
         }
+        else if (arg == "--fastMath" && (transformType == "AGCWHD" || autoTransform))
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                fastMath = (std::string(argv[++i]) == "true");
+            }
+            else
+            {
+                std::cerr << "Error: '--fastMath' requires 'true' or 'false'.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--gainMapScale" && (transformType == "locHE" || transformType == "AGCWHD" || autoTransform))
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                gainMapScale = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--gainMapScale' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--autoQuality" && autoTransform)
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                autoQuality = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--autoQuality' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--autoTargetFps" && autoTransform)
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                autoTargetFps = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--autoTargetFps' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--tileSkipSize")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                tileSkipSize = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--tileSkipSize' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--tileSkipThreshold")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                tileSkipThreshold = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--tileSkipThreshold' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--passThroughThreshold" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                passThroughThreshold = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--passThroughThreshold' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--passThroughHysteresis" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                passThroughHysteresis = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--passThroughHysteresis' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--denoiseFrames" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                denoiseFrames = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--denoiseFrames' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--denoiseThreshold" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                denoiseThreshold = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--denoiseThreshold' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--yuvOutput" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                yuvOutput = std::string(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--yuvOutput' requires 'y4m' or 'mp4'.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--startFrame" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                startFrame = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--startFrame' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--endFrame" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                endFrame = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--endFrame' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--startTime" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                startTime = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--startTime' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--endTime" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                endTime = std::stod(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--endTime' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--frameStep" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                frameStep = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--frameStep' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--sampleFrames" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                sampleFrames = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--sampleFrames' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--previewOutput" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                previewOutput = std::string(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--previewOutput' requires 'clip' or 'stills'.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--frameCacheMaxMB" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                frameCacheMaxMB = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--frameCacheMaxMB' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--renditions" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                renditions = std::string(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--renditions' requires a comma-separated list of heights.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--threads")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                budget.totalThreads = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--threads' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--frameWorkers" && mode == "video")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                budget.frameWorkers = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--frameWorkers' requires a value.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--pinThreads")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                budget.pinThreads = (std::string(argv[++i]) == "true");
+            }
+            else
+            {
+                std::cerr << "Error: '--pinThreads' requires 'true' or 'false'.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--profile")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                profile = (std::string(argv[++i]) == "true");
+            }
+            else
+            {
+                std::cerr << "Error: '--profile' requires 'true' or 'false'.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--trackAllocations")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                trackAllocations = (std::string(argv[++i]) == "true");
+            }
+            else
+            {
+                std::cerr << "Error: '--trackAllocations' requires 'true' or 'false'.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--cacheDir")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                cacheDir = argv[++i];
+            }
+            else
+            {
+                std::cerr << "Error: '--cacheDir' requires a directory.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--cacheMaxMB")
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                cacheMaxMB = std::stoi(argv[++i]);
+            }
+            else
+            {
+                std::cerr << "Error: '--cacheMaxMB' requires a value.\n";
+                return -1;
+            }
+        }
         else
         {
             std::cerr << "Unknown parameter: " << arg << "\n";
@@ -168,39 +629,114 @@ int main (int argc, char *argv[])
         return -1;
     }
 
-    // Create further directories and paths depending on the provided raw file path
-    const std::string rawFile = rawFileName + "." + rawFileType;
-    const std::string rawFilePath = rawFileDir + "/" + rawFile;
-    const std::string modFileDir = std::filesystem::path(rawFileDir).parent_path().std::filesystem::path::string() + "/mod/";
+    // The 'auto' transform type falls back to the default parameters of the transforms it may choose
+    if (autoTransform)
+    {
+        const EnhancementSettings defaults;
+        inputScale = inputScaleProvided ? inputScale : defaults.inputScale;
+        clipLimit = clipLimitProvided ? clipLimit : defaults.clipLimit;
+    }
 
-    // Process the file according to the chosen mode
-    if (mode == "image")
+    if (denoiseFrames < 0 || denoiseFrames > maxDenoiseFrames)
     {
-        const std::string histDir = std::filesystem::path(rawFileDir).parent_path().std::filesystem::path::string() + "/hist/";
-        const std::string modFilePath = modFileDir + rawFileName + "_" + transformType + ".jpg";
+        std::cerr << "Error: '--denoiseFrames' must be between 0 and " << maxDenoiseFrames << ".\n";
+        return -1;
+    }
 
-        processImage(
-            rawFilePath, rawFileName, rawFile, modFilePath, histDir, mode, transformType, L, verbose, inputScale, clipLimit, tileGridSize);
-        
-        if (show)
-        {
-        QApplication app(argc, argv);
-        ReadImageQt readImageQt;
-        readImageQt.showImage(QString::fromStdString(modFilePath));
-        readImageQt.show();
-        return app.exec();
-        }
+    if (!yuvOutput.empty() && yuvOutput != "y4m" && yuvOutput != "mp4")
+    {
+        std::cerr << "Error: '--yuvOutput' requires 'y4m' or 'mp4'.\n";
+        return -1;
     }
-    else if (mode == "video")
+
+    if (previewOutput != "clip" && previewOutput != "stills")
     {
-        const std::string modFilePath = modFileDir + rawFileName + "_" + transformType + ".mp4";
+        std::cerr << "Error: '--previewOutput' requires 'clip' or 'stills'.\n";
+        return -1;
+    }
 
-        processVideo(
-            rawFilePath, rawFileName, modFilePath, mode, transformType, L, verbose, inputScale, clipLimit, tileGridSize);
+    std::vector<int> renditionHeights;
+    if (!renditions.empty() && !parseRenditions(renditions, renditionHeights))
+    {
+        std::cerr << "Error: '--renditions' requires a comma-separated list of heights.\n";
+        return -1;
     }
-    else
+
+    // Split the thread budget between frame workers and OpenCV's pool
+    // (the counters only see the profiled thread, so profiling runs everything on it)
+    if (profile)
     {
-        std::cerr << "Error: Unknown mode: " << mode << "\n";
+        budget.totalThreads = 1;
+        budget.frameWorkers = 1;
+        setProfilingEnabled(true);
+    }
+    if (trackAllocations)
+    {
+        // Allocations are counted process-wide, so stages are only attributed exactly with a single frame worker
+        budget.frameWorkers = 1;
+        setAllocationTrackingEnabled(true);
+    }
+    setThreadBudget(planThreadBudget(budget));
+
+    // Set up the job and process the file according to the chosen mode
+    JobSpec job;
+    job.mode = mode;
+    job.rawFileDir = rawFileDir;
+    job.rawFileName = rawFileName;
+    job.rawFileType = rawFileType;
+    job.verbose = verbose;
+    job.settings.transformType = transformType;
+    job.settings.L = L;
+    job.settings.autoQuality = autoQuality;
+    job.settings.autoTargetFps = autoTargetFps;
+    job.settings.inputScale = inputScale;
+    job.settings.clipLimit = clipLimit;
+    job.settings.tileGridSize = tileGridSize;
+    job.settings.fastMath = fastMath;
+    job.settings.gainMapScale = gainMapScale;
+    job.settings.tileSkipSize = tileSkipSize;
+    job.settings.tileSkipThreshold = tileSkipThreshold;
+    job.settings.passThroughThreshold = passThroughThreshold;
+    job.settings.passThroughHysteresis = passThroughHysteresis;
+    job.settings.denoiseFrames = denoiseFrames;
+    job.settings.denoiseThreshold = denoiseThreshold;
+    job.settings.yuvOutput = yuvOutput;
+    job.settings.startFrame = startFrame;
+    job.settings.endFrame = endFrame;
+    job.settings.startTime = startTime;
+    job.settings.endTime = endTime;
+    job.settings.frameStep = frameStep;
+    job.settings.sampleFrames = sampleFrames;
+    job.settings.previewOutput = previewOutput;
+    job.settings.frameCacheMaxMB = frameCacheMaxMB;
+    job.settings.renditions = renditions;
+
+    std::unique_ptr<ResultCache> cache;
+    if (!cacheDir.empty())
+    {
+        cache = std::make_unique<ResultCache>(cacheDir, static_cast<uint64_t>(cacheMaxMB) * 1024 * 1024);
+    }
+
+    std::string modFilePath;
+    cv::Mat modImage;
+    const bool success = runJob(job, modFilePath, cv::Mat(), show ? &modImage : nullptr, cache.get());
+    if (profile || trackAllocations)
+    {
+        printProfileReport();
+    }
+    if (!success)
+    {
+        return -1;
+    }
+
+    // Show the processed image straight from memory instead of reading it back from disk
+    if (mode == "image" && show)
+    {
+        QApplication app(argc, argv);
+        ReadImageQt readImageQt;
+        readImageQt.showImage(modImage);
+        readImageQt.show();
+        return app.exec();
     }
 
     return 0;
@@ -0,0 +1,382 @@
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <mutex>
+#include "utils.h"
+#include "manifest.h"
+#include "mappedinput.h"
+#include "resultcache.h"
+#include "perfcounters.h"
+#include "ladder.h"
+#include <memory>
+
+static std::string readString(const cv::FileNode& node, const std::string& key, const std::string& defaultValue)
+{
+    const cv::FileNode value = node[key];
+    return value.isString() ? value.string() : defaultValue;
+}
+
+static double readDouble(const cv::FileNode& node, const std::string& key, const double defaultValue)
+{
+    const cv::FileNode value = node[key];
+    return (value.isInt() || value.isReal()) ? value.real() : defaultValue;
+}
+
+static int readInt(const cv::FileNode& node, const std::string& key, const int defaultValue)
+{
+    const cv::FileNode value = node[key];
+    return (value.isInt() || value.isReal()) ? static_cast<int>(value.real()) : defaultValue;
+}
+
+static bool readBool(const cv::FileNode& node, const std::string& key, const bool defaultValue)
+{
+    // Booleans are given either as 'true'/'false' strings or as 0/1 numbers
+    const cv::FileNode value = node[key];
+    if (value.isString())
+    {
+        return value.string() == "true";
+    }
+    if (value.isInt())
+    {
+        return static_cast<int>(value) != 0;
+    }
+    return defaultValue;
+}
+
+bool readEnhancementSettings(const cv::FileNode& node, EnhancementSettings& settings, std::string& errorMessage)
+{
+    settings.transformType = readString(node, "transformType", settings.transformType);
+    settings.L = readInt(node, "L", settings.L);
+    settings.autoQuality = readDouble(node, "autoQuality", settings.autoQuality);
+    settings.autoTargetFps = readDouble(node, "autoTargetFps", settings.autoTargetFps);
+    settings.inputScale = readDouble(node, "inputScale", settings.inputScale);
+    settings.clipLimit = readDouble(node, "clipLimit", settings.clipLimit);
+    settings.tileGridSize.width = readInt(node, "tileGridWidth", settings.tileGridSize.width);
+    settings.tileGridSize.height = readInt(node, "tileGridHeight", settings.tileGridSize.height);
+    settings.fastMath = readBool(node, "fastMath", settings.fastMath);
+    settings.gainMapScale = readInt(node, "gainMapScale", settings.gainMapScale);
+    settings.tileSkipSize = readInt(node, "tileSkipSize", settings.tileSkipSize);
+    settings.tileSkipThreshold = readDouble(node, "tileSkipThreshold", settings.tileSkipThreshold);
+    settings.passThroughThreshold = readDouble(node, "passThroughThreshold", settings.passThroughThreshold);
+    settings.passThroughHysteresis = readDouble(node, "passThroughHysteresis", settings.passThroughHysteresis);
+    settings.denoiseFrames = readInt(node, "denoiseFrames", settings.denoiseFrames);
+    settings.denoiseThreshold = readDouble(node, "denoiseThreshold", settings.denoiseThreshold);
+    settings.yuvOutput = readString(node, "yuvOutput", settings.yuvOutput);
+    settings.startFrame = readInt(node, "startFrame", settings.startFrame);
+    settings.endFrame = readInt(node, "endFrame", settings.endFrame);
+    settings.startTime = readDouble(node, "startTime", settings.startTime);
+    settings.endTime = readDouble(node, "endTime", settings.endTime);
+    settings.frameStep = readInt(node, "frameStep", settings.frameStep);
+    settings.sampleFrames = readInt(node, "sampleFrames", settings.sampleFrames);
+    settings.previewOutput = readString(node, "previewOutput", settings.previewOutput);
+    settings.frameCacheMaxMB = readInt(node, "frameCacheMaxMB", settings.frameCacheMaxMB);
+    settings.renditions = readString(node, "renditions", settings.renditions);
+
+    if (settings.transformType != "log" && settings.transformType != "locHE" && settings.transformType != "globHE" && settings.transformType != "AGCWHD"
+        && settings.transformType != "auto")
+    {
+        errorMessage = "unknown transformType '" + settings.transformType + "'";
+        return false;
+    }
+    if (!settings.yuvOutput.empty() && settings.yuvOutput != "y4m" && settings.yuvOutput != "mp4")
+    {
+        errorMessage = "unknown yuvOutput '" + settings.yuvOutput + "'";
+        return false;
+    }
+    if (settings.previewOutput != "clip" && settings.previewOutput != "stills")
+    {
+        errorMessage = "unknown previewOutput '" + settings.previewOutput + "'";
+        return false;
+    }
+    std::vector<int> heights;
+    if (!settings.renditions.empty() && !parseRenditions(settings.renditions, heights))
+    {
+        errorMessage = "malformed renditions '" + settings.renditions + "'";
+        return false;
+    }
+    return true;
+}
+
+bool readJobSpec(const cv::FileNode& node, JobSpec& job, std::string& errorMessage)
+{
+    if (!node.isMap())
+    {
+        errorMessage = "job is not a map";
+        return false;
+    }
+
+    job.mode = readString(node, "mode", "");
+
+    // The raw file is either given as one path or, like on the command line, as directory, name and type
+    const std::string rawFilePath = readString(node, "rawFilePath", "");
+    if (!rawFilePath.empty())
+    {
+        const std::filesystem::path path(rawFilePath);
+        job.rawFileDir = path.parent_path().string();
+        job.rawFileName = path.stem().string();
+        job.rawFileType = path.extension().string();
+        if (!job.rawFileType.empty() && job.rawFileType[0] == '.')
+        {
+            job.rawFileType.erase(0, 1);
+        }
+    }
+    else
+    {
+        job.rawFileDir = readString(node, "rawFileDir", "");
+        job.rawFileName = readString(node, "rawFileName", "");
+        job.rawFileType = readString(node, "rawFileType", "");
+    }
+
+    job.verbose = readBool(node, "verbose", job.verbose);
+    if (!readEnhancementSettings(node, job.settings, errorMessage))
+    {
+        return false;
+    }
+
+    if (job.mode != "image" && job.mode != "video")
+    {
+        errorMessage = "unknown mode '" + job.mode + "'";
+        return false;
+    }
+    if (job.rawFileDir.empty() || job.rawFileName.empty() || job.rawFileType.empty())
+    {
+        errorMessage = "missing 'rawFilePath' or 'rawFileDir'/'rawFileName'/'rawFileType'";
+        return false;
+    }
+    return true;
+}
+
+bool readManifest(const std::string& manifestPath, Manifest& manifest)
+{
+    cv::FileStorage fs;
+    try
+    {
+        fs.open(manifestPath, cv::FileStorage::READ);
+    }
+    catch (const cv::Exception& e)
+    {
+        std::cerr << "Error: Manifest could not be parsed: " << e.what() << "\n";
+        return false;
+    }
+    if (!fs.isOpened())
+    {
+        std::cerr << "Error: Manifest file could not be opened." << "\n";
+        return false;
+    }
+
+    const cv::FileNode jobNodes = fs["jobs"];
+    if (!jobNodes.isSeq())
+    {
+        std::cerr << "Error: Manifest requires a 'jobs' list." << "\n";
+        return false;
+    }
+
+    manifest.cacheDir = readString(fs.root(), "cacheDir", manifest.cacheDir);
+    manifest.cacheMaxMB = readInt(fs.root(), "cacheMaxMB", manifest.cacheMaxMB);
+    ThreadBudget& budget = manifest.budget;
+    budget.totalThreads = readInt(fs.root(), "threads", budget.totalThreads);
+    budget.fileWorkers = readInt(fs.root(), "fileWorkers", budget.fileWorkers);
+    budget.frameWorkers = readInt(fs.root(), "frameWorkers", budget.frameWorkers);
+    budget.intraFrameThreads = readInt(fs.root(), "intraFrameThreads", budget.intraFrameThreads);
+    budget.pinThreads = readBool(fs.root(), "pinThreads", budget.pinThreads);
+
+    manifest.profile = readBool(fs.root(), "profile", manifest.profile);
+    manifest.trackAllocations = readBool(fs.root(), "trackAllocations", manifest.trackAllocations);
+
+    // A malformed job only fails itself, the other jobs are still run
+    manifest.jobs.clear();
+    manifest.jobErrors.clear();
+    int index = 0;
+    for (cv::FileNodeIterator it = jobNodes.begin(); it != jobNodes.end(); ++it, ++index)
+    {
+        JobSpec job;
+        std::string errorMessage;
+        if (!readJobSpec(*it, job, errorMessage))
+        {
+            std::cerr << "Error: Manifest job " << index << ": " << errorMessage << "\n";
+        }
+        manifest.jobs.push_back(job);
+        manifest.jobErrors.push_back(errorMessage);
+    }
+    return true;
+}
+
+int runJobList(const std::vector<JobSpec>& jobs, ResultCache* cache, const bool verbose, std::vector<JobResult>* results)
+{
+    // Images are memory-mapped and decoded on a read-ahead thread while the previous jobs are processed (cache hits are never decoded)
+    std::vector<std::string> imagePaths;
+    std::vector<bool> prefetched(jobs.size(), false);
+    for (size_t index = 0; index < jobs.size(); ++index)
+    {
+        const JobSpec& job = jobs[index];
+        std::string cacheKey;
+        if (job.mode == "image" && !(cache && cache->computeKey(getRawFilePath(job), job.mode, job.settings, cacheKey) && cache->contains(cacheKey)))
+        {
+            imagePaths.push_back(getRawFilePath(job));
+            prefetched[index] = true;
+        }
+    }
+    ImagePrefetcher prefetcher(imagePaths);
+
+    // All jobs run in this process, so cached CLAHE objects, OpenCV's thread pool and allocations stay warm;
+    // the file workers take the jobs in order, so the prefetched images are consumed in the order they are decoded
+    std::vector<JobResult> jobResults(jobs.size());
+    std::mutex jobMutex;
+    size_t nextIndex = 0;
+    int failedCount = 0;
+    const int fileWorkers = std::min(getThreadBudget().fileWorkers, static_cast<int>(std::max<size_t>(1, jobs.size())));
+    runConcurrently(fileWorkers, [&](int)
+    {
+        while (true)
+        {
+            size_t index;
+            cv::Mat rawImage;
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                if (nextIndex >= jobs.size())
+                {
+                    return;
+                }
+                index = nextIndex++;
+                if (prefetched[index])
+                {
+                    rawImage = prefetcher.next();
+                }
+            }
+
+            const JobSpec& job = jobs[index];
+            JobResult& result = jobResults[index];
+            const auto start = std::chrono::steady_clock::now();
+            try
+            {
+                result.success = runJob(job, result.modFilePath, rawImage, nullptr, cache);
+            }
+            catch (const std::exception& e)
+            {
+                // Any exception only fails this job, so the remaining jobs still run and the results are still written
+                std::cerr << "Error: Job " << index << " failed: " << e.what() << "\n";
+                result.success = false;
+                result.errorMessage = e.what();
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (!result.success)
+            {
+                failedCount++;
+            }
+            if (verbose)
+            {
+                std::cout << "Job " << index << " (" << job.rawFileName << ", " << job.settings.transformType << "): "
+                    << (result.success ? "ok" : "failed") << " in " << result.seconds << " s\n";
+            }
+        }
+    });
+
+    if (results != nullptr)
+    {
+        *results = std::move(jobResults);
+    }
+    return failedCount;
+}
+
+int runManifest(const std::string& manifestPath, const std::string& resultsPath, const bool verbose)
+{
+    Manifest manifest;
+    if (!readManifest(manifestPath, manifest))
+    {
+        return -1;
+    }
+
+    // Profiling counts on the calling thread only, so it runs everything there; allocations are counted process-wide,
+    // so they are only attributed exactly with one job and one frame at a time
+    ThreadBudget budget = manifest.budget;
+    if (manifest.profile)
+    {
+        budget.totalThreads = 1;
+        budget.frameWorkers = 1;
+        setProfilingEnabled(true);
+    }
+    if (manifest.trackAllocations)
+    {
+        budget.fileWorkers = 1;
+        budget.frameWorkers = 1;
+        setAllocationTrackingEnabled(true);
+    }
+    setThreadBudget(planThreadBudget(budget));
+
+    createDirectory(resultsPath);
+    cv::FileStorage results(resultsPath, cv::FileStorage::WRITE);
+    if (!results.isOpened())
+    {
+        std::cerr << "Error: Results file could not be opened." << "\n";
+        return -1;
+    }
+
+    // Optionally, serve unchanged inputs from a result cache (configured next to the job list)
+    std::unique_ptr<ResultCache> cache;
+    if (!manifest.cacheDir.empty())
+    {
+        cache = std::make_unique<ResultCache>(manifest.cacheDir, static_cast<uint64_t>(manifest.cacheMaxMB) * 1024 * 1024);
+    }
+
+    // Only the valid jobs are run, malformed ones are reported as failed with their error
+    const std::vector<JobSpec>& jobs = manifest.jobs;
+    std::vector<JobSpec> validJobs;
+    std::vector<size_t> resultIndices(jobs.size(), 0);
+    int failedCount = 0;
+    for (size_t index = 0; index < jobs.size(); ++index)
+    {
+        if (manifest.jobErrors[index].empty())
+        {
+            resultIndices[index] = validJobs.size();
+            validJobs.push_back(jobs[index]);
+        }
+        else
+        {
+            failedCount++;
+        }
+    }
+
+    std::vector<JobResult> jobResults;
+    failedCount += runJobList(validJobs, cache.get(), verbose, &jobResults);
+
+    results << "results" << "[";
+    for (size_t index = 0; index < jobs.size(); ++index)
+    {
+        const JobSpec& job = jobs[index];
+        const JobResult jobResult = manifest.jobErrors[index].empty() ? jobResults[resultIndices[index]] : JobResult();
+        const std::string& errorMessage = manifest.jobErrors[index].empty() ? jobResult.errorMessage : manifest.jobErrors[index];
+        results << "{"
+            << "index" << static_cast<int>(index)
+            << "mode" << job.mode
+            << "rawFile" << (job.rawFileName.empty() ? std::string() : getRawFilePath(job))
+            << "modFile" << jobResult.modFilePath
+            << "transformType" << job.settings.transformType
+            << "status" << (jobResult.success ? "ok" : "failed")
+            << "seconds" << jobResult.seconds;
+        if (!errorMessage.empty())
+        {
+            results << "errorMessage" << errorMessage;
+        }
+        results << "}";
+    }
+    results << "]";
+    results << "failed" << failedCount;
+    results.release();
+
+    if (isProfilingEnabled() || isAllocationTrackingEnabled())
+    {
+        printProfileReport();
+    }
+    if (verbose && cache)
+    {
+        std::cout << "Result cache: " << cache->hits() << " hits, " << cache->misses() << " misses\n";
+    }
+    if (verbose)
+    {
+        std::cout << "Processed " << jobs.size() << " jobs (" << failedCount << " failed), results saved under: " << resultsPath << "\n";
+    }
+    return (failedCount == 0) ? 0 : 1;
+}
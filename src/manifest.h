@@ -0,0 +1,48 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "processor.h"
+#include "scheduler.h"
+
+// Function to read the transform type and parameters from a manifest/request node, returns false if they are invalid
+bool readEnhancementSettings(const cv::FileNode& node, EnhancementSettings& settings, std::string& errorMessage);
+
+// Function to read a single job from a manifest node, returns false if mandatory fields are missing
+bool readJobSpec(const cv::FileNode& node, JobSpec& job, std::string& errorMessage);
+
+// Jobs of a manifest with the optional result cache and thread budget settings
+struct Manifest
+{
+    std::vector<JobSpec> jobs;                  // all jobs in the order of the manifest
+    std::vector<std::string> jobErrors;         // per job, why it is malformed (empty for valid jobs, which are the only ones run)
+    std::string cacheDir;
+    int cacheMaxMB = 1024;
+    ThreadBudget budget;                        // as given in the manifest; profiling and allocation tracking are applied when it is run
+    bool profile = false;                       // profile all jobs with hardware counters
+    bool trackAllocations = false;              // track the allocations of all jobs
+};
+
+// Function to read all jobs and the optional result cache and thread budget settings from a JSON/YAML manifest
+// (returns false only if the manifest itself is unusable; malformed jobs are recorded in jobErrors)
+bool readManifest(const std::string& manifestPath, Manifest& manifest);
+
+// Outcome of a single job of a job list
+struct JobResult
+{
+    std::string modFilePath;
+    bool success = false;
+    double seconds = 0.0;
+    std::string errorMessage;                   // Exception that aborted the job (empty otherwise)
+};
+
+// Function to run a list of jobs on the file workers of the global thread budget, returns the number of failed jobs
+// (per-job results are returned in the order of the jobs if requested)
+int runJobList(const std::vector<JobSpec>& jobs, ResultCache* cache, const bool verbose, std::vector<JobResult>* results = nullptr);
+
+// Function to run all jobs of a manifest in this process and write the per-job status to a JSON/YAML results file
+int runManifest(const std::string& manifestPath, const std::string& resultsPath, const bool verbose = false);
+
+#endif
@@ -0,0 +1,201 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <utility>
+#include "mappedinput.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+    open(path);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap(mappedData, other.mappedData);
+        std::swap(mappedSize, other.mappedSize);
+#ifdef _WIN32
+        std::swap(fileHandle, other.fileHandle);
+        std::swap(mappingHandle, other.mappingHandle);
+#endif
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = static_cast<uchar*>(view);
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // The whole file is decoded right away, so ask the kernel to fault it in ahead of the decoder
+    madvise(view, static_cast<size_t>(fileStat.st_size), MADV_WILLNEED);
+    mappedData = static_cast<uchar*>(view);
+    mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mappedData == nullptr)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mappedData);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(mappedData, mappedSize);
+#endif
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+cv::Mat MappedFile::buffer() const
+{
+    if (!isOpen())
+    {
+        return cv::Mat();
+    }
+    return cv::Mat(1, static_cast<int>(mappedSize), CV_8UC1, mappedData);
+}
+
+cv::Mat readImageMapped(const std::string& path, const int flags)
+{
+    const MappedFile file(path);
+    if (!file.isOpen())
+    {
+        // Fall back to OpenCV's own reader, e.g. for special files that cannot be mapped
+        return cv::imread(path, flags);
+    }
+    return cv::imdecode(file.buffer(), flags);
+}
+
+ImagePrefetcher::ImagePrefetcher(const std::vector<std::string>& paths, const size_t readAhead)
+    : paths(paths), readAhead(std::max<size_t>(1, readAhead)), worker(&ImagePrefetcher::run, this)
+{
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    condition.notify_all();
+    worker.join();
+}
+
+void ImagePrefetcher::run()
+{
+    while (true)
+    {
+        std::string path;
+        {
+            // Wait until there is room for another decoded image
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stop || ready.size() < readAhead; });
+            if (stop || produced == paths.size())
+            {
+                return;
+            }
+            path = paths[produced];
+        }
+
+        cv::Mat image = readImageMapped(path);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(image);
+            produced++;
+        }
+        condition.notify_all();
+    }
+}
+
+cv::Mat ImagePrefetcher::next()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (consumed == paths.size())
+    {
+        return cv::Mat();
+    }
+    condition.wait(lock, [this]() { return !ready.empty(); });
+    cv::Mat image = ready.front();
+    ready.pop_front();
+    consumed++;
+    condition.notify_all();
+    return image;
+}
@@ -0,0 +1,74 @@
+#ifndef MAPPED_INPUT_H
+#define MAPPED_INPUT_H
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return mappedData != nullptr; }
+    const uchar* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+
+    // Header over the mapped bytes (no copy), valid as long as the mapping is open
+    cv::Mat buffer() const;
+
+private:
+    uchar* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+// Function to decode an image directly from its memory-mapped file, without reading it into an intermediate buffer
+cv::Mat readImageMapped(const std::string& path, const int flags = cv::IMREAD_COLOR);
+
+// Decodes a list of images on a read-ahead thread, so decoding the next files overlaps with processing the current one
+class ImagePrefetcher
+{
+public:
+    explicit ImagePrefetcher(const std::vector<std::string>& paths, const size_t readAhead = 4);
+    ~ImagePrefetcher();
+
+    ImagePrefetcher(const ImagePrefetcher&) = delete;
+    ImagePrefetcher& operator=(const ImagePrefetcher&) = delete;
+
+    // Returns the next decoded image in the order of the paths (empty if it could not be decoded or all were consumed)
+    cv::Mat next();
+
+private:
+    void run();
+
+    std::vector<std::string> paths;
+    size_t readAhead;
+    size_t consumed = 0;
+    size_t produced = 0;
+    bool stop = false;
+    std::deque<cv::Mat> ready;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread worker;
+};
+
+#endif
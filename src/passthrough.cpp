@@ -0,0 +1,32 @@
+#include <opencv2/opencv.hpp>
+#include "autoselect.h"
+#include "passthrough.h"
+
+PassThroughGate::PassThroughGate(const double threshold, const double hysteresis, const int L)
+    : enterThreshold(threshold + 0.5 * hysteresis), leaveThreshold(threshold - 0.5 * hysteresis), L(L)
+{
+}
+
+bool PassThroughGate::check(const cv::Mat& frame)
+{
+    // A sparse sample of the intensities is enough to tell day from night
+    const FrameFeatures features = computeFrameFeatures(frame, L, 8);
+    const double meanIntensity = (1.0 - features.darkness) * (L - 1);
+
+    // The dynamic range has its own, fixed hysteresis band
+    if (passing)
+    {
+        passing = (meanIntensity >= leaveThreshold && features.dynamicRange >= 0.4);
+    }
+    else
+    {
+        passing = (meanIntensity >= enterThreshold && features.dynamicRange >= 0.5);
+    }
+
+    checkedCount++;
+    if (passing)
+    {
+        passedCount++;
+    }
+    return passing;
+}
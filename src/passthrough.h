@@ -0,0 +1,30 @@
+#ifndef PASS_THROUGH_H
+#define PASS_THROUGH_H
+
+#include <opencv2/opencv.hpp>
+
+// Decides frame by frame whether a video frame is well exposed and can be passed to the writer unchanged
+// A frame is well exposed if its sampled mean intensity reaches the threshold and it spans at least half of the intensity range;
+// the hysteresis band keeps the decision from toggling on frames near the threshold (e.g. at dusk)
+class PassThroughGate
+{
+public:
+    // Frames start to be passed through above threshold + hysteresis / 2 and are enhanced again below threshold - hysteresis / 2
+    PassThroughGate(const double threshold, const double hysteresis, const int L);
+
+    // Returns true if the frame (BGR or a single-channel luma plane) should be passed through, must be called in frame order
+    bool check(const cv::Mat& frame);
+
+    int passedFrames() const { return passedCount; }
+    int checkedFrames() const { return checkedCount; }
+
+private:
+    double enterThreshold;
+    double leaveThreshold;
+    int L;
+    bool passing = false;
+    int passedCount = 0;
+    int checkedCount = 0;
+};
+
+#endif
@@ -0,0 +1,318 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include "perfcounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PERF_COUNTERS_SUPPORTED 1
+#else
+#define PERF_COUNTERS_SUPPORTED 0
+#endif
+
+// Accumulated counts of a stage
+struct StageTotals
+{
+    uint64_t calls = 0;
+    uint64_t pixels = 0;
+    double seconds = 0.0;
+    std::array<double, PERF_EVENT_COUNT> counts{};
+    uint64_t newCalls = 0;
+    uint64_t newBytes = 0;
+    uint64_t deleteCalls = 0;
+    uint64_t matAllocations = 0;
+    uint64_t matBytes = 0;
+    uint64_t maxCallBytes = 0;
+    uint64_t peakRSSGrowth = 0;
+    uint64_t firstRSS = 0;
+    uint64_t lastRSS = 0;
+};
+
+static std::atomic<bool> profilingEnabled(false);
+static std::atomic<bool> countersUnavailableReported(false);
+static std::mutex totalsMutex;
+static std::map<std::string, StageTotals> stageTotals;
+static std::atomic<bool> eventAvailable[PERF_EVENT_COUNT];
+
+#if PERF_COUNTERS_SUPPORTED
+// Per-thread counter file descriptors, opened on first use (-1 where an event is not available)
+struct ThreadCounters
+{
+    std::array<int, PERF_EVENT_COUNT> fds;
+
+    ThreadCounters()
+    {
+        const std::array<std::pair<uint32_t, uint64_t>, PERF_EVENT_COUNT> events = {{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+        }};
+
+        for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+        {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = events[event].first;
+            attr.config = events[event].second;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            // Count the calling thread on any CPU; fails without permission (perf_event_paranoid) or in many VMs
+            fds[event] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds[event] >= 0)
+            {
+                eventAvailable[event] = true;
+            }
+        }
+    }
+
+    ~ThreadCounters()
+    {
+        for (const int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    // Reads all counters, scaled up if the kernel had to multiplex them
+    std::array<double, PERF_EVENT_COUNT> read() const
+    {
+        std::array<double, PERF_EVENT_COUNT> counts{};
+        for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+        {
+            uint64_t values[3] = {0, 0, 0};
+            if (fds[event] >= 0 && ::read(fds[event], values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)) && values[2] > 0)
+            {
+                counts[event] = static_cast<double>(values[0]) * values[1] / values[2];
+            }
+        }
+        return counts;
+    }
+
+    bool anyOpen() const
+    {
+        for (const int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static ThreadCounters& getThreadCounters()
+{
+    thread_local ThreadCounters counters;
+    return counters;
+}
+#endif
+
+void setProfilingEnabled(const bool enabled)
+{
+    profilingEnabled = enabled;
+}
+
+bool isProfilingEnabled()
+{
+    return profilingEnabled;
+}
+
+ProfileScope::ProfileScope(const char* stage, const cv::Mat& image)
+    : stage(stage), pixels(static_cast<uint64_t>(image.total()))
+{
+    start();
+}
+
+ProfileScope::ProfileScope(const char* stage, const uint64_t pixels)
+    : stage(stage), pixels(pixels)
+{
+    start();
+}
+
+void ProfileScope::start()
+{
+    if (!profilingEnabled && !isAllocationTrackingEnabled())
+    {
+        return;
+    }
+    active = true;
+    if (isAllocationTrackingEnabled())
+    {
+        startAllocations = getAllocationCounts();
+        startPeakRSS = getPeakRSS();
+    }
+    if (!profilingEnabled)
+    {
+        startTicks = cv::getTickCount();
+        return;
+    }
+#if PERF_COUNTERS_SUPPORTED
+    const ThreadCounters& counters = getThreadCounters();
+    if (!counters.anyOpen() && !countersUnavailableReported.exchange(true))
+    {
+        std::cerr << "Warning: Hardware counters are unavailable (check /proc/sys/kernel/perf_event_paranoid), only timing stages.\n";
+    }
+    startCounts = counters.read();
+#else
+    if (!countersUnavailableReported.exchange(true))
+    {
+        std::cerr << "Warning: Hardware counters are only supported on Linux, only timing stages.\n";
+    }
+#endif
+    startTicks = cv::getTickCount();
+}
+
+ProfileScope::~ProfileScope()
+{
+    if (!active)
+    {
+        return;
+    }
+    const int64_t endTicks = cv::getTickCount();
+    std::array<double, PERF_EVENT_COUNT> endCounts = startCounts;
+#if PERF_COUNTERS_SUPPORTED
+    if (profilingEnabled)
+    {
+        endCounts = getThreadCounters().read();
+    }
+#endif
+    const bool tracking = isAllocationTrackingEnabled();
+    const AllocationCounts endAllocations = tracking ? getAllocationCounts() : startAllocations;
+    const uint64_t endPeakRSS = tracking ? getPeakRSS() : startPeakRSS;
+    const uint64_t currentRSS = tracking ? getCurrentRSS() : 0;
+
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    StageTotals& totals = stageTotals[stage];
+    totals.calls++;
+    totals.pixels += pixels;
+    totals.seconds += (endTicks - startTicks) / cv::getTickFrequency();
+    for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+    {
+        totals.counts[event] += endCounts[event] - startCounts[event];
+    }
+    if (tracking)
+    {
+        const uint64_t callBytes = (endAllocations.newBytes - startAllocations.newBytes) + (endAllocations.matBytes - startAllocations.matBytes);
+        totals.newCalls += endAllocations.newCalls - startAllocations.newCalls;
+        totals.newBytes += endAllocations.newBytes - startAllocations.newBytes;
+        totals.deleteCalls += endAllocations.deleteCalls - startAllocations.deleteCalls;
+        totals.matAllocations += endAllocations.matAllocations - startAllocations.matAllocations;
+        totals.matBytes += endAllocations.matBytes - startAllocations.matBytes;
+        totals.maxCallBytes = std::max(totals.maxCallBytes, callBytes);
+        totals.peakRSSGrowth += endPeakRSS - startPeakRSS;
+        if (totals.calls == 1)
+        {
+            totals.firstRSS = currentRSS;
+        }
+        totals.lastRSS = currentRSS;
+    }
+}
+
+// Function to print the hardware counter table
+static void printCounterReport(std::ostream& out)
+{
+    // Per-pixel figure of an event, or n/a if it could not be counted
+    const auto perPixel = [](const StageTotals& totals, const int event)
+    {
+        std::ostringstream value;
+        if (eventAvailable[event] && totals.pixels > 0)
+        {
+            value << std::fixed << std::setprecision(3) << totals.counts[event] / totals.pixels;
+        }
+        else
+        {
+            value << "n/a";
+        }
+        return value.str();
+    };
+
+    out << "\n" << "Profile (per pixel, user space only):\n"
+        << std::left << std::setw(22) << "stage" << std::right
+        << std::setw(7) << "calls" << std::setw(10) << "MPix" << std::setw(11) << "ms"
+        << std::setw(8) << "IPC" << std::setw(11) << "cycles" << std::setw(10) << "L1 miss"
+        << std::setw(10) << "LLC miss" << std::setw(11) << "br. miss" << "\n";
+    for (const auto& pair : stageTotals)
+    {
+        const StageTotals& totals = pair.second;
+        std::ostringstream ipc;
+        if (eventAvailable[PERF_CYCLES] && eventAvailable[PERF_INSTRUCTIONS] && totals.counts[PERF_CYCLES] > 0)
+        {
+            ipc << std::fixed << std::setprecision(2) << totals.counts[PERF_INSTRUCTIONS] / totals.counts[PERF_CYCLES];
+        }
+        else
+        {
+            ipc << "n/a";
+        }
+        out << std::left << std::setw(22) << pair.first << std::right
+            << std::setw(7) << totals.calls
+            << std::setw(10) << std::fixed << std::setprecision(2) << totals.pixels / 1e6
+            << std::setw(11) << std::setprecision(2) << totals.seconds * 1e3
+            << std::setw(8) << ipc.str()
+            << std::setw(11) << perPixel(totals, PERF_CYCLES)
+            << std::setw(10) << perPixel(totals, PERF_L1_MISSES)
+            << std::setw(10) << perPixel(totals, PERF_LLC_MISSES)
+            << std::setw(11) << perPixel(totals, PERF_BRANCH_MISSES) << "\n";
+    }
+}
+
+// Function to print the allocation table; the resident memory of the first and last call of a stage shows creep over frames
+static void printAllocationReport(std::ostream& out)
+{
+    const double mb = 1.0 / (1024.0 * 1024.0);
+    out << "\n" << "Allocations (per call):\n"
+        << std::left << std::setw(22) << "stage" << std::right
+        << std::setw(7) << "calls" << std::setw(11) << "ms" << std::setw(10) << "new" << std::setw(10) << "delete"
+        << std::setw(10) << "new MB" << std::setw(8) << "Mats" << std::setw(10) << "Mat MB" << std::setw(12) << "max MB"
+        << std::setw(13) << "peak RSS +MB" << std::setw(16) << "RSS first/last" << "\n";
+    for (const auto& pair : stageTotals)
+    {
+        const StageTotals& totals = pair.second;
+        const double calls = static_cast<double>(std::max<uint64_t>(1, totals.calls));
+        std::ostringstream rss;
+        rss << std::fixed << std::setprecision(0) << totals.firstRSS * mb << "/" << totals.lastRSS * mb;
+        out << std::left << std::setw(22) << pair.first << std::right << std::fixed
+            << std::setw(7) << totals.calls
+            << std::setw(11) << std::setprecision(2) << totals.seconds * 1e3 / calls
+            << std::setw(10) << std::setprecision(1) << totals.newCalls / calls
+            << std::setw(10) << totals.deleteCalls / calls
+            << std::setw(10) << std::setprecision(2) << totals.newBytes * mb / calls
+            << std::setw(8) << std::setprecision(1) << totals.matAllocations / calls
+            << std::setw(10) << std::setprecision(2) << totals.matBytes * mb / calls
+            << std::setw(12) << totals.maxCallBytes * mb
+            << std::setw(13) << totals.peakRSSGrowth * mb
+            << std::setw(16) << rss.str() << "\n";
+    }
+    out << "Peak resident memory: " << std::setprecision(1) << getPeakRSS() * mb << " MB\n";
+}
+
+void printProfileReport(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    if (stageTotals.empty())
+    {
+        return;
+    }
+    if (profilingEnabled)
+    {
+        printCounterReport(out);
+    }
+    if (isAllocationTrackingEnabled())
+    {
+        printAllocationReport(out);
+    }
+}
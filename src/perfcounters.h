@@ -0,0 +1,57 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "alloctrack.h"
+
+// Hardware events counted per profiled stage
+enum PerfEvent
+{
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+};
+
+// Function to switch profiling on or off; on Linux, hardware counters are opened through perf_event_open where permitted
+// (stages are then timed and counted on the calling thread only, so profiling should run with a single thread)
+void setProfilingEnabled(const bool enabled);
+
+// Function to check whether profiling is switched on
+bool isProfilingEnabled();
+
+// Counts the hardware events, the wall-clock time and (with allocation tracking) the allocations and resident memory of a stage
+// from construction to destruction (no-op without profiling and allocation tracking)
+class ProfileScope
+{
+public:
+    ProfileScope(const char* stage, const cv::Mat& image);
+    ProfileScope(const char* stage, const uint64_t pixels);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    void start();
+
+    const char* stage;
+    uint64_t pixels;
+    bool active = false;
+    int64_t startTicks = 0;
+    std::array<double, PERF_EVENT_COUNT> startCounts{};
+    AllocationCounts startAllocations;
+    uint64_t startPeakRSS = 0;
+};
+
+// Function to print the IPC and the per-pixel cycles, cache misses and branch misses of all profiled stages,
+// and with allocation tracking the allocations, allocated bytes and resident memory per call of each stage
+void printProfileReport(std::ostream& out = std::cout);
+
+#endif
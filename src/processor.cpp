@@ -1,57 +1,139 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
 #include <filesystem>
+#include <map>
+#include <memory>
 #include "utils.h"
 #include "processor.h"
+#include "mappedinput.h"
+#include "resultcache.h"
+#include "tileskip.h"
+#include "denoise.h"
+#include "gainmap.h"
+#include "scheduler.h"
+#include "perfcounters.h"
+#include "yuvvideo.h"
+#include "frameselect.h"
+#include "autoselect.h"
+#include "passthrough.h"
+#include "ladder.h"
+#include "framecache.h"
 
-void processImage(
+double enhanceFrame(
+    cv::Mat& frame, const EnhancementSettings& settings, const std::string& fileName, const bool plotHistograms,
+    const bool verbose, const std::string& histDir, const std::string& file, TransformScratch* scratch)
+{
+    // Choose the transform from the features of the unstretched frame and the measured costs
+    if (settings.transformType == "auto")
+    {
+        TransformDecision decision;
+        {
+            ProfileScope profile("selectTransform", frame);
+            decision = selectTransform(frame, settings);
+        }
+        if (verbose)
+        {
+            printTransformDecision(decision);
+        }
+        EnhancementSettings chosenSettings = settings;
+        chosenSettings.transformType = decision.transformType;
+        return enhanceFrame(frame, chosenSettings, fileName, plotHistograms, verbose, histDir, file, scratch);
+    }
+
+    // Only enhance the dark tiles of the frame if requested
+    if (settings.tileSkipSize > 0)
+    {
+        ProfileScope profile("enhanceFrameTiled", frame);
+        return enhanceFrameTiled(frame, settings, fileName, plotHistograms, verbose, histDir, file, scratch);
+    }
+
+    // Without buffers of the caller, the statistics and lookup tables only live for this call
+    TransformScratch localScratch;
+    scratch = (scratch != nullptr) ? scratch : &localScratch;
+
+    // Gather the frame statistics once and stretch the color channels
+    {
+        ProfileScope profile("computeFrameStats", frame);
+        computeFrameStats(frame, scratch->stats, settings.L);
+    }
+    {
+        ProfileScope profile("stretchColorChannels", frame);
+        stretchColorChannels(frame, 0, settings.L, &scratch->stats, &scratch->stretchLUT);
+    }
+
+    // Estimate local enhancements at a lower resolution and apply them as a gain map if requested
+    if (settings.gainMapScale > 1 && (settings.transformType == "locHE" || settings.transformType == "AGCWHD"))
+    {
+        ProfileScope profile("enhanceFrameGainMap", frame);
+        enhanceFrameGainMap(frame, settings, fileName, plotHistograms, verbose, histDir, file, scratch);
+        return 0.0;
+    }
+
+    // Perform transformation depending on the chosen transform type
+    if (settings.transformType == "log")
+    {
+        ProfileScope profile("transformLogarithmic", frame);
+        transformLogarithmic(frame, settings.inputScale, settings.L, &scratch->stats, &scratch->transformLUT);
+    }
+    else if (settings.transformType == "locHE")
+    {
+        ProfileScope profile("transformHistEqual", frame);
+        transformHistEqual(frame, settings.clipLimit, settings.tileGridSize, "local", &scratch->channels);
+    }
+    else if (settings.transformType == "globHE")
+    {
+        ProfileScope profile("transformHistEqual", frame);
+        transformHistEqual(frame, settings.clipLimit, settings.tileGridSize, "global", &scratch->channels);
+    }
+    else if (settings.transformType == "AGCWHD")
+    {
+        ProfileScope profile("transformAGCWHD", frame);
+        transformAGCWHD(frame, settings.L, fileName, plotHistograms, verbose, histDir, file, settings.fastMath, scratch);
+    }
+    return 0.0;
+}
+
+bool processImage(
     const std::string& rawImagePath, const std::string& fileName, const std::string& file, const std::string& modImageFilePath,
-    const std::string& histDir, const std::string& mode, const std::string transformType, const int L, const bool verbose,
-    const double inputScale, const double clipLimit, const cv::Size& tileGridSize)
+    const std::string& histDir, const std::string& mode, const EnhancementSettings& settings, const bool verbose,
+    const cv::Mat& rawImage, cv::Mat* modImage)
 {
-    cv::Mat image = cv::imread(rawImagePath);
+    cv::Mat image = rawImage.empty() ? readImageMapped(rawImagePath) : rawImage;
     if(image.empty())
     {
         std::cerr << "Error: Image file could not be opened." << "\n";
-        return;
+        return false;
     }
 
-    // Fit image to window and stretch the color channels
+    // Fit image to window and enhance it
     image = fitImageToWindow(image, 1280, 720);
-    stretchColorChannels(image, 0, L);
-
-    // Perform image transformation depending on the chosen transform type
-    if (transformType == "log")
+    double skippedFraction;
     {
-        transformLogarithmic(image, inputScale, L);
+        ProfileScope profile("enhanceFrame", image);
+        skippedFraction = enhanceFrame(image, settings, fileName, mode == "image", verbose, histDir, file);
     }
-    else if (transformType == "locHE")
+    if (verbose && settings.tileSkipSize > 0)
     {
-        transformHistEqual(image, clipLimit, tileGridSize, "local");
+        std::cout << "Pixels skipped in bright tiles: " << 100.0 * skippedFraction << "%\n";
     }
-    else if (transformType == "globHE")
+    if (modImage != nullptr)
     {
-        transformHistEqual(image, clipLimit, tileGridSize, "global");
-    }
-    else if (transformType == "AGCWHD")
-    {
-        transformAGCWHD(image, L, fileName, mode, verbose, histDir, file);
+        *modImage = image;
     }
 
     // Save the modified image
-    saveImage(image, modImageFilePath, verbose);
+    return saveImage(image, modImageFilePath, verbose);
 }
 
-void processVideo(
+bool processVideo(
     const std::string& rawVideoPath, const std::string& fileName, const std::string& modVideoFilePath,
-    const std::string& mode,const std::string& transformType, const int L, const bool verbose, 
-    const double inputScale, const double clipLimit, const cv::Size& tileGridSize)
+    const std::string& mode, const EnhancementSettings& settings, const bool verbose)
 {   
     cv::VideoCapture cap(rawVideoPath);
     if (!cap.isOpened())
     {
         std::cerr << "Error: Video file could not be opened." << "\n";
-        return;
+        return false;
     }
     
     // Set up mod video file path
@@ -67,57 +149,312 @@ void processVideo(
         std::cout << "frameWidth: " << frameWidth << ", frameHeight: " << frameHeight << ", fps: " << fps << "\n";
     }
 
-    // Set up the output video writer
-    cv::VideoWriter writer(modVideoFilePath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, cv::Size(frameWidth, frameHeight));
+    const bool writeStills = (settings.previewOutput == "stills");
+
+    // Set up the output video writer at the size of the fitted frames, unless the frames are saved as still images
+    // With renditions, frames are enhanced at the highest one and every rendition gets its own writer
+    cv::VideoWriter writer;
+    std::unique_ptr<RenditionLadder> ladder;
+    cv::Size outputSize = fitFrameSize(cv::Size(frameWidth, frameHeight), 1280, 720);
+    if (!writeStills && !settings.renditions.empty())
+    {
+        std::vector<int> heights;
+        if (!parseRenditions(settings.renditions, heights))
+        {
+            std::cerr << "Error: Renditions must be a comma-separated list of heights." << "\n";
+            return false;
+        }
+        ladder = std::make_unique<RenditionLadder>(modVideoFilePath, fileName, cv::Size(frameWidth, frameHeight), fps, heights);
+        if (!ladder->isOpened())
+        {
+            std::cerr << "Error: Video writer could not be opened." << "\n";
+            return false;
+        }
+        outputSize = ladder->topSize();
+    }
+    else if (!writeStills)
+    {
+        writer.open(modVideoFilePath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, outputSize);
+        if (!writer.isOpened())
+        {
+            std::cerr << "Error: Video writer could not be opened." << "\n";
+            return false;
+        }
+    }
+
+    // Optionally, take the decoded and fitted frames from the frame cache of an earlier run, or fill it on a full pass
+    std::unique_ptr<DecodedFrameCache> frameCache;
+    if (settings.frameCacheMaxMB > 0)
+    {
+        // The ladder resizes with area interpolation, fitImageToWindow with bilinear interpolation
+        frameCache = std::make_unique<DecodedFrameCache>(rawVideoPath, outputSize, ladder ? cv::INTER_AREA : cv::INTER_LINEAR,
+            static_cast<uint64_t>(settings.frameCacheMaxMB) * 1024 * 1024);
+    }
+    const bool readFromCache = frameCache && frameCache->isReadable();
 
-    if (!writer.isOpened())
+    // Only read the selected frames (for previews), seeking over larger gaps
+    FrameSelector selector(cap, settings, readFromCache ? frameCache.get() : nullptr);
+    const bool fillFrameCache = frameCache && !readFromCache && !selector.isPartial()
+        && frameCache->beginWrite(static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT)));
+    if (verbose && readFromCache)
     {
-        std::cerr << "Error: Video writer could not be opened." << "\n";
-        return;
+        std::cout << "Reading " << frameCache->frameCount() << " decoded frames from the frame cache\n";
     }
 
     cv::Mat frame;
     int frameCount = 0;
+    double skippedFractionSum = 0.0;
+
+    // Temporal denoising runs on the enhanced frames in the same pass, over a ring buffer of the previous ones
+    // (only if the frames are neighbours in time)
+    std::unique_ptr<TemporalDenoiser> denoiser;
+    if (settings.denoiseFrames > 0 && selector.isContiguous())
+    {
+        denoiser = std::make_unique<TemporalDenoiser>(settings.denoiseFrames, settings.denoiseThreshold);
+    }
+
+    // Well-exposed frames skip the stretching, the transformation and the denoising and go straight to the writer
+    std::unique_ptr<PassThroughGate> gate;
+    if (settings.passThroughThreshold > 0.0)
+    {
+        gate = std::make_unique<PassThroughGate>(settings.passThroughThreshold, settings.passThroughHysteresis, settings.L);
+    }
 
-    while (true)
+    // With several frame workers, batches of frames are enhanced concurrently and then denoised and written in order
+    const int frameWorkers = getThreadBudget().frameWorkers;
+    std::vector<cv::Mat> batch(frameWorkers);
+    std::vector<int> batchIndices(frameWorkers, 0);
+    std::vector<double> skippedFractions(frameWorkers, 0.0);
+    std::vector<char> passThrough(frameWorkers, 0);
+    const bool autoTransform = (settings.transformType == "auto");
+    std::vector<EnhancementSettings> frameSettings(frameWorkers, settings);
+    std::vector<TransformDecision> decisions(frameWorkers);
+    std::vector<TransformScratch> frameScratch(frameWorkers);
+    std::map<std::string, int> transformCounts;
+    std::string previousTransform;
+    bool endOfVideo = false;
+
+    while (!endOfVideo)
     {
-        cap >> frame;
-        if (frame.empty())
+        int batchSize = 0;
+        while (batchSize < frameWorkers)
         {
-            break;
+            if (!selector.read(frame, batchIndices[batchSize]))
+            {
+                endOfVideo = true;
+                break;
+            }
+            if (ladder)
+            {
+                cv::resize(frame, batch[batchSize], outputSize, 0, 0, cv::INTER_AREA);
+            }
+            else
+            {
+                batch[batchSize] = fitImageToWindow(frame, 1280, 720);
+            }
+            if (fillFrameCache)
+            {
+                frameCache->append(batch[batchSize]);
+            }
+
+            // The gate keeps state across frames, so it is checked here in frame order
+            if (gate)
+            {
+                ProfileScope profile("passThroughCheck", batch[batchSize]);
+                passThrough[batchSize] = gate->check(batch[batchSize]);
+            }
+            batchSize++;
         }
-            
-        frame = fitImageToWindow(frame, 1280, 720);
-        stretchColorChannels(frame, 0, L);
 
-        if (transformType == "log")
+        // With the "auto" transform type, the transform is chosen here, so the decisions can be logged in frame order
+        const auto enhanceBatchFrame = [&](int index)
         {
-            transformLogarithmic(frame, inputScale, L);
-        }
-        else if (transformType == "locHE")
+            if (passThrough[index])
+            {
+                skippedFractions[index] = 0.0;
+                return;
+            }
+            if (autoTransform)
+            {
+                ProfileScope profile("selectTransform", batch[index]);
+                decisions[index] = selectTransform(batch[index], settings);
+                frameSettings[index].transformType = decisions[index].transformType;
+            }
+            ProfileScope profile("enhanceFrame", batch[index]);
+            skippedFractions[index] = enhanceFrame(batch[index], frameSettings[index], fileName, false, false, "", "", &frameScratch[index]);
+        };
+        if (batchSize == 1)
         {
-            transformHistEqual(frame, clipLimit, tileGridSize, "local");
+            enhanceBatchFrame(0);
         }
-        else if (transformType == "globHE")
+        else if (batchSize > 1)
         {
-            transformHistEqual(frame, clipLimit, tileGridSize, "global");
+            runConcurrently(batchSize, enhanceBatchFrame);
         }
-        else if (transformType == "AGCWHD")
+
+        for (int index = 0; index < batchSize; ++index)
         {
-            transformAGCWHD(frame, L, fileName, mode, false);
+            skippedFractionSum += skippedFractions[index];
+            if (autoTransform && !passThrough[index])
+            {
+                transformCounts[decisions[index].transformType]++;
+                if (verbose && decisions[index].transformType != previousTransform)
+                {
+                    std::cout << "Frame " << batchIndices[index] << ": ";
+                    printTransformDecision(decisions[index]);
+                }
+                previousTransform = decisions[index].transformType;
+            }
+            if (denoiser && passThrough[index])
+            {
+                // Frames after a pass-through period must not be blended with the enhanced frames before it
+                denoiser->reset();
+            }
+            else if (denoiser)
+            {
+                ProfileScope profile("temporalDenoise", batch[index]);
+                denoiser->apply(batch[index]);
+            }
+
+            // Write the processed frame to the output video file, or save it as a still image named after its frame index
+            if (writeStills)
+            {
+                const std::filesystem::path stillPath = std::filesystem::path(modVideoFilePath) / (fileName + "_" + std::to_string(batchIndices[index]) + ".jpg");
+                if (!saveImage(batch[index], stillPath.string()))
+                {
+                    return false;
+                }
+            }
+            else if (!ladder)
+            {
+                writer.write(batch[index]);
+            }
+            frameCount++;
         }
 
-        // Write the processed frame to the output video file
-        writer.write(frame);
-        frameCount++;
+        // All renditions of the batch are resized and encoded concurrently
+        if (ladder && batchSize > 0)
+        {
+            ladder->write(batch, batchSize);
+        }
     }
 
     // Release ressources
     cap.release();
     writer.release();
+    if (ladder)
+    {
+        ladder->release();
+    }
+    if (fillFrameCache && frameCache->finishWrite() && verbose)
+    {
+        std::cout << "Decoded frames saved in the frame cache under: " << getFrameCacheDir(rawVideoPath) << "\n";
+    }
 
-    if (verbose)
+    if (verbose && settings.tileSkipSize > 0 && frameCount > 0)
+    {
+        std::cout << "Pixels skipped in bright tiles: " << 100.0 * skippedFractionSum / frameCount << "%\n";
+    }
+    if (verbose && gate && gate->checkedFrames() > 0)
+    {
+        std::cout << "Frames passed through unchanged: " << gate->passedFrames() << " of " << gate->checkedFrames()
+            << " (" << 100.0 * gate->passedFrames() / gate->checkedFrames() << "%)\n";
+    }
+    if (verbose && autoTransform)
+    {
+        std::cout << "Auto transform frames:";
+        for (const auto& count : transformCounts)
+        {
+            std::cout << " " << count.first << " " << count.second;
+        }
+        std::cout << "\n";
+    }
+    if (verbose && selector.isPartial())
+    {
+        std::cout << "Preview of " << frameCount << " selected frames\n";
+    }
+    if (verbose && ladder)
+    {
+        ladder->printRenditions();
+    }
+    else if (verbose)
     {
         std::cout << "Processed video saved under: " << modVideoFilePath << "\n";
     }
-}   
\ No newline at end of file
+    return true;
+}
+
+std::string getRawFilePath(const JobSpec& job)
+{
+    return (std::filesystem::path(job.rawFileDir) / (job.rawFileName + "." + job.rawFileType)).string();
+}
+
+bool runJob(const JobSpec& job, std::string& modFilePath, const cv::Mat& rawImage, cv::Mat* modImage, ResultCache* cache)
+{
+    // Create further directories and paths depending on the provided raw file path
+    const std::string rawFile = job.rawFileName + "." + job.rawFileType;
+    const std::string rawFilePath = getRawFilePath(job);
+    const std::filesystem::path baseDir = std::filesystem::path(job.rawFileDir).parent_path();
+    const std::string modFileStem = (baseDir / "mod" / (job.rawFileName + "_" + job.settings.transformType)).string();
+    modFilePath = modFileStem + ((job.mode == "video") ? ((job.settings.yuvOutput == "y4m") ? ".y4m" : ".mp4") : ".jpg");
+    if (job.mode == "video" && job.settings.previewOutput == "stills")
+    {
+        // Preview stills are saved into a directory next to where the video would go
+        modFilePath = modFileStem + "_stills";
+    }
+    else if (job.mode == "video" && !job.settings.renditions.empty() && job.settings.yuvOutput.empty())
+    {
+        // So are the renditions of an output ladder
+        modFilePath = modFileStem + "_renditions";
+    }
+
+    // Serve unchanged inputs from the cache
+    std::string cacheKey;
+    if (cache != nullptr && cache->computeKey(rawFilePath, job.mode, job.settings, cacheKey))
+    {
+        if (cache->fetch(cacheKey, modFilePath))
+        {
+            if (job.verbose)
+            {
+                std::cout << "Cached result linked under: " << modFilePath << "\n";
+            }
+            if (modImage != nullptr)
+            {
+                *modImage = readImageMapped(modFilePath);
+            }
+            return true;
+        }
+    }
+
+    // A previous cache hit may have hard-linked the output to the cache, so unlink it before it is rewritten (only regular
+    // files; the stills and renditions outputs are directories, whose link count is always at least 2)
+    std::error_code linkError;
+    if (std::filesystem::is_regular_file(modFilePath, linkError) && std::filesystem::hard_link_count(modFilePath, linkError) > 1)
+    {
+        std::filesystem::remove(modFilePath, linkError);
+    }
+
+    // Process the file according to the chosen mode
+    bool success = false;
+    if (job.mode == "image")
+    {
+        const std::string histDir = (baseDir / "hist").string() + "/";
+        success = processImage(rawFilePath, job.rawFileName, rawFile, modFilePath, histDir, job.mode, job.settings, job.verbose, rawImage, modImage);
+    }
+    else if (job.mode == "video")
+    {
+        success = job.settings.yuvOutput.empty()
+            ? processVideo(rawFilePath, job.rawFileName, modFilePath, job.mode, job.settings, job.verbose)
+            : processVideoYUV(rawFilePath, modFilePath, job.settings, job.verbose);
+    }
+    else
+    {
+        std::cerr << "Error: Unknown mode: " << job.mode << "\n";
+    }
+
+    if (success && !cacheKey.empty())
+    {
+        cache->store(cacheKey, modFilePath);
+    }
+    return success;
+}
@@ -4,16 +4,74 @@
 #include <opencv2/opencv.hpp>
 #include <string>
 
-// Function to process an image
-void processImage(
+struct TransformScratch;
+
+// Transform type and parameters shared by image and video processing
+struct EnhancementSettings
+{
+    std::string transformType = "log";          // Transform type: "log", "locHE", "globHE", "AGCWHD" or "auto" (chosen per image/frame)
+    int L = 256;                                // Number of possible intensity values
+    double autoQuality = 0.8;                   // predicted quality (0 - 1) the cheapest chosen transform has to reach (only for "auto")
+    double autoTargetFps = 0.0;                 // throughput target in frames per second (only for "auto", 0 disables it)
+    double inputScale = 0.2;                    // input scale (only for logarithmic transformation)
+    double clipLimit = 40;                      // clip limit (only for local histogram equalization)
+    cv::Size tileGridSize = cv::Size(8, 8);     // tile grid size (only for local histogram equalization)
+    bool fastMath = false;                      // fast-math HSI conversions (only for AGCWHD)
+    int gainMapScale = 1;                       // downsampling factor of the gain map (only for locHE and AGCWHD, 1 disables it)
+    int tileSkipSize = 0;                       // tile size for adaptive dark-region tile skipping (0 disables it)
+    double tileSkipThreshold = 100.0;           // sampled mean intensity from which a tile counts as bright
+    double passThroughThreshold = 0.0;          // sampled mean intensity from which a well-exposed frame is written unchanged (only for videos, 0 disables it)
+    double passThroughHysteresis = 10.0;        // width of the band around passThroughThreshold in which the decision of the previous frame is kept
+    int denoiseFrames = 0;                      // previous frames for temporal denoising (only for videos, 0 disables it)
+    double denoiseThreshold = 20.0;             // pixel difference from which temporal denoising treats a pixel as moving
+    std::string yuvOutput;                      // native YUV video path: "y4m" (no color conversion) or "mp4" (one conversion), empty disables it
+    int startFrame = 0;                         // first processed frame (only for videos)
+    int endFrame = -1;                          // frame after the last processed one (only for videos, -1 = until the end)
+    double startTime = -1.0;                    // start of the processed time range in seconds (only for videos, overrides startFrame)
+    double endTime = -1.0;                      // end of the processed time range in seconds (only for videos, overrides endFrame)
+    int frameStep = 1;                          // process every n-th frame (only for videos)
+    int sampleFrames = 0;                       // process this many evenly spaced frames of the range (only for videos, 0 disables it)
+    std::string previewOutput = "clip";         // output of the selected frames: "clip" (video) or "stills" (one image per frame)
+    int frameCacheMaxMB = 0;                    // size limit of the decoded-frame cache next to the video (only for videos, 0 disables it)
+    std::string renditions;                     // comma-separated output heights, e.g. "1080,720,480" (only for videos, empty = one output fitted to 1280 x 720)
+};
+
+// Description of a single enhancement job, as given on the command line or in a manifest
+struct JobSpec
+{
+    std::string mode;                           // mode: "image" or "video"
+    std::string rawFileDir;                     // Directory of raw file
+    std::string rawFileName;                    // Name of raw file
+    std::string rawFileType;                    // Type of raw file
+    EnhancementSettings settings;
+    bool verbose = false;
+};
+
+// Function to stretch and transform a single image/frame in place according to the settings
+// (histograms are only plotted with plotHistograms and a histDir and file; if provided, the transforms reuse the buffers in scratch)
+// Returns the fraction of pixels passed through unchanged (only non-zero with tile skipping)
+double enhanceFrame(
+    cv::Mat& frame, const EnhancementSettings& settings, const std::string& fileName, const bool plotHistograms,
+    const bool verbose = false, const std::string& histDir = "", const std::string& file = "", TransformScratch* scratch = nullptr);
+
+// Function to process an image (an already decoded rawImage is used instead of reading rawImagePath, the result is also returned in modImage)
+bool processImage(
     const std::string& rawImagePath, const std::string& fileName, const std::string& file, const std::string& modImageFilePath,
-    const std::string& histDir, const std::string& mode, const std::string transformType, const int L, const bool verbose,
-    const double inputScale = 0.2, const double clipLimit = 40, const cv::Size& tileGridSize = cv::Size(8, 8));
+    const std::string& histDir, const std::string& mode, const EnhancementSettings& settings, const bool verbose,
+    const cv::Mat& rawImage = cv::Mat(), cv::Mat* modImage = nullptr);
 
 // Function to process a video
-void processVideo(
-    const std::string& rawVideoPath, const std::string& fileName, const std::string& modVideoFilePath, 
-    const std::string& mode, const std::string& transformType, const int L, const bool verbose,
-    const double inputScale = 0.2, const double clipLimit = 40, const cv::Size& tileGridSize = cv::Size(8, 8));
+bool processVideo(
+    const std::string& rawVideoPath, const std::string& fileName, const std::string& modVideoFilePath,
+    const std::string& mode, const EnhancementSettings& settings, const bool verbose);
+
+class ResultCache;
+
+// Function to get the path of the raw file of a job
+std::string getRawFilePath(const JobSpec& job);
+
+// Function to derive the output paths of a job and run it, returns false if the job failed
+// (with a cache, unchanged inputs are served from it without decoding)
+bool runJob(const JobSpec& job, std::string& modFilePath, const cv::Mat& rawImage = cv::Mat(), cv::Mat* modImage = nullptr, ResultCache* cache = nullptr);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,486 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include "utils.h"
+#include "processor.h"
+#include "enhancer.h"
+#include "denoise.h"
+#include "scheduler.h"
+#include "regression.h"
+
+// Largest per-channel difference from the golden output accepted for each transform type
+// (the HSI conversions of AGCWHD and the interpolation of CLAHE round differently across compilers and SIMD paths)
+static int getTolerance(const std::string& transformType)
+{
+    if (transformType == "locHE" || transformType == "AGCWHD")
+    {
+        return 2;
+    }
+    return 1;
+}
+
+// Function to turn a case name into a valid key of a cv::FileStorage map
+static std::string toKey(const std::string& name)
+{
+    std::string key = name;
+    for (char& character : key)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(character)))
+        {
+            character = '_';
+        }
+    }
+    return key;
+}
+
+// Function to build a frame of the synthetic video: a dark scene with a bright window and a moving object, plus fixed noise
+static cv::Mat makeSyntheticFrame(const int index)
+{
+    cv::Mat frame(360, 640, CV_8UC3);
+    for (int y = 0; y < frame.rows; ++y)
+    {
+        cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < frame.cols; ++x)
+        {
+            const int base = 10 + (40 * x) / frame.cols + (20 * y) / frame.rows;
+            row[x] = cv::Vec3b(static_cast<uchar>(base + 6), static_cast<uchar>(base + 3), static_cast<uchar>(base));
+        }
+    }
+    cv::rectangle(frame, cv::Rect(440, 40, 120, 90), cv::Scalar(150, 190, 210), cv::FILLED);
+    cv::circle(frame, cv::Point(60 + 10 * index, 250), 30, cv::Scalar(30, 70, 90), cv::FILLED);
+
+    cv::Mat noise(frame.size(), CV_8UC3);
+    cv::RNG rng(1000 + index);
+    rng.fill(noise, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(6));
+    cv::add(frame, noise, frame);
+    return frame;
+}
+
+// Function to build an image holding every 8-bit colour once (4096 x 4096 pixels)
+static cv::Mat makeAllColoursImage()
+{
+    cv::Mat image(4096, 4096, CV_8UC3);
+    for (int y = 0; y < image.rows; ++y)
+    {
+        cv::Vec3b* row = image.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < image.cols; ++x)
+        {
+            const int colour = y * image.cols + x;
+            row[x] = cv::Vec3b(static_cast<uchar>(colour & 255), static_cast<uchar>((colour >> 8) & 255), static_cast<uchar>(colour >> 16));
+        }
+    }
+    return image;
+}
+
+// Function to get the largest per-channel difference between two images of the same size and type
+static int getMaxDifference(const cv::Mat& first, const cv::Mat& second)
+{
+    cv::Mat difference;
+    cv::absdiff(first, second, difference);
+    double maxDifference = 0.0;
+    cv::minMaxLoc(difference.reshape(1), nullptr, &maxDifference);
+    return static_cast<int>(maxDifference);
+}
+
+// Function to get the variance of the difference between a frame and the clean frame it was derived from, over all channels
+static double getNoiseVariance(const cv::Mat& frame, const cv::Mat& clean)
+{
+    cv::Mat difference;
+    cv::subtract(frame, clean, difference, cv::noArray(), CV_32F);
+    cv::Scalar mean, stdDev;
+    cv::meanStdDev(difference.reshape(1), mean, stdDev);
+    return stdDev[0] * stdDev[0];
+}
+
+// Function to check whether a directory holds any golden image
+static bool hasGoldenImages(const std::string& goldenDir)
+{
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(goldenDir, error))
+    {
+        if (file.path().extension() == ".png")
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Result of a single regression case
+struct RegressionCase
+{
+    std::string name;
+    bool passed = true;
+    int maxDifference = 0;
+    double mpixPerSecond = 0.0;
+    double baselineMpixPerSecond = 0.0;
+    std::string note;
+};
+
+// Function to compare an output with its golden image, or to write it as the new golden image
+static void checkOutput(const cv::Mat& output, const std::filesystem::path& goldenPath, const int tolerance, const bool update,
+    RegressionCase& result)
+{
+    if (update)
+    {
+        if (!cv::imwrite(goldenPath.string(), output))
+        {
+            result.passed = false;
+            result.note = "golden image could not be written";
+        }
+        return;
+    }
+
+    const cv::Mat golden = cv::imread(goldenPath.string(), cv::IMREAD_COLOR);
+    if (golden.empty() || golden.size() != output.size())
+    {
+        result.passed = false;
+        result.note = golden.empty() ? "golden image missing" : "size differs from golden image";
+        return;
+    }
+    const int maxDifference = getMaxDifference(output, golden);
+    result.maxDifference = std::max(result.maxDifference, maxDifference);
+    if (maxDifference > tolerance)
+    {
+        result.passed = false;
+        result.note = "output differs from golden image";
+    }
+}
+
+// Function to compare a fastMath output with the exact one, which needs no golden image
+static void checkFastMath(const cv::Mat& fastOutput, const cv::Mat& exactOutput, const int tolerance, RegressionCase& result)
+{
+    const int maxDifference = getMaxDifference(fastOutput, exactOutput);
+    result.maxDifference = std::max(result.maxDifference, maxDifference);
+    if (maxDifference > tolerance)
+    {
+        result.passed = false;
+        result.note = "fastMath differs from the exact path";
+    }
+}
+
+// Function to compare an approximate output with the exact one by the mean per-channel difference, which needs no golden image
+// (the maximum is only reported, since sampled statistics move single pixels further)
+static void checkMeanDifference(const cv::Mat& output, const cv::Mat& exactOutput, const double tolerance, RegressionCase& result)
+{
+    cv::Mat difference;
+    cv::absdiff(output, exactOutput, difference);
+    const cv::Scalar channelMeans = cv::mean(difference);
+    const double meanDifference = (channelMeans[0] + channelMeans[1] + channelMeans[2]) / 3.0;
+    result.maxDifference = std::max(result.maxDifference, getMaxDifference(output, exactOutput));
+    std::ostringstream note;
+    note << std::fixed << std::setprecision(2) << "mean difference " << meanDifference;
+    result.note = note.str();
+    if (meanDifference > tolerance)
+    {
+        result.passed = false;
+        result.note += " above " + std::to_string(tolerance).substr(0, 4);
+    }
+}
+
+int runRegressionSuite(const std::string& rawImageDir, const std::string& goldenDir, const bool update, const double allowedRegression)
+{
+    // Sample images in a fixed order
+    std::vector<std::filesystem::path> imagePaths;
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(rawImageDir, error))
+    {
+        std::string extension = file.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp")
+        {
+            imagePaths.push_back(file.path());
+        }
+    }
+    std::sort(imagePaths.begin(), imagePaths.end());
+    if (imagePaths.empty())
+    {
+        std::cerr << "Error: No sample images found in: " << rawImageDir << "\n";
+        return -1;
+    }
+    if (update)
+    {
+        std::filesystem::create_directories(goldenDir, error);
+    }
+
+    // Without goldens every case that compares with one fails, so a missing golden directory cannot pass unnoticed
+    if (!update && !hasGoldenImages(goldenDir))
+    {
+        std::cerr << "Error: No golden images found in " << goldenDir << ", generate them on a known-good build with: "
+            << "boost.exe regress " << rawImageDir << " " << goldenDir << " true\n";
+    }
+
+    // The baseline is only comparable with the same thread budget
+    const std::filesystem::path baselinePath = std::filesystem::path(goldenDir) / "baseline.yml";
+    std::map<std::string, double> baseline;
+    int baselineThreads = 0;
+    if (!update)
+    {
+        cv::FileStorage baselineFile(baselinePath.string(), cv::FileStorage::READ);
+        if (baselineFile.isOpened())
+        {
+            baselineThreads = static_cast<int>(baselineFile["threads"].real());
+            const cv::FileNode throughput = baselineFile["mpixPerSecond"];
+            for (const auto& entry : throughput)
+            {
+                baseline[entry.name()] = entry.real();
+            }
+        }
+        else
+        {
+            std::cerr << "Warning: No throughput baseline found, only the outputs are compared.\n";
+        }
+    }
+    setThreadBudget(planThreadBudget(ThreadBudget()));
+    const int threads = getThreadBudget().totalThreads;
+    if (baselineThreads > 0 && baselineThreads != threads)
+    {
+        std::cerr << "Warning: The baseline was measured with " << baselineThreads << " threads, this run uses " << threads << ".\n";
+    }
+
+    const char* const transformTypes[] = {"log", "locHE", "globHE", "AGCWHD"};
+    std::vector<RegressionCase> results;
+
+    for (const char* transformType : transformTypes)
+    {
+        EnhancementSettings settings;
+        settings.transformType = transformType;
+
+        // Images at the size processImage enhances them at, timed as the fastest of three runs
+        for (const std::filesystem::path& imagePath : imagePaths)
+        {
+            RegressionCase result;
+            result.name = imagePath.stem().string() + "_" + transformType;
+            const cv::Mat image = cv::imread(imagePath.string(), cv::IMREAD_COLOR);
+            if (image.empty())
+            {
+                result.passed = false;
+                result.note = "image could not be read";
+                results.push_back(result);
+                continue;
+            }
+            const cv::Mat fitted = fitImageToWindow(image, 1280, 720);
+            cv::Mat output;
+            double bestSeconds = -1.0;
+            for (int run = 0; run < 3; ++run)
+            {
+                fitted.copyTo(output);
+                const auto start = std::chrono::steady_clock::now();
+                enhanceFrame(output, settings, imagePath.stem().string(), false);
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                bestSeconds = (bestSeconds < 0.0) ? seconds : std::min(bestSeconds, seconds);
+            }
+            result.mpixPerSecond = 1e-6 * fitted.total() / bestSeconds;
+            checkOutput(output, std::filesystem::path(goldenDir) / (result.name + ".png"), getTolerance(transformType), update, result);
+            results.push_back(result);
+        }
+
+        // The synthetic video runs through the stream path with temporal denoising, so the golden frames also cover the denoiser
+        RegressionCase result;
+        result.name = std::string("synthetic_") + transformType;
+        settings.denoiseFrames = 4;
+        Enhancer enhancer(settings);
+        const int frameTotal = 32;
+        cv::Mat frame;
+        double seconds = 0.0;
+        for (int index = 0; index < frameTotal; ++index)
+        {
+            const cv::Mat input = makeSyntheticFrame(index);
+            const auto start = std::chrono::steady_clock::now();
+            enhancer.enhanceNext(input, frame);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (index == 0 || index == frameTotal - 1)
+            {
+                checkOutput(frame, std::filesystem::path(goldenDir) / (result.name + "_" + std::to_string(index) + ".png"),
+                    getTolerance(transformType), update, result);
+            }
+        }
+        result.mpixPerSecond = 1e-6 * frame.total() * frameTotal / seconds;
+        results.push_back(result);
+    }
+
+    // fastMath against the exact path: the HSI codes have to be identical for every colour, every BGR output channel
+    // within 1 LSB for every HSI code, and so the AGCWHD output within 1 LSB on the sample images and synthetic frames
+    {
+        const cv::Mat allColours = makeAllColoursImage();
+        cv::Mat fastOutput;
+        cv::Mat exactOutput;
+
+        RegressionCase toHSI;
+        toHSI.name = "fastMath_BGRToHSI";
+        const auto toHSIStart = std::chrono::steady_clock::now();
+        transformBGRToHSI(allColours, fastOutput, 256, "BGR", true);
+        toHSI.mpixPerSecond = 1e-6 * allColours.total() / std::chrono::duration<double>(std::chrono::steady_clock::now() - toHSIStart).count();
+        transformBGRToHSI(allColours, exactOutput, 256, "BGR", false);
+        checkFastMath(fastOutput, exactOutput, 0, toHSI);
+        results.push_back(toHSI);
+
+        RegressionCase toBGR;
+        toBGR.name = "fastMath_HSIToBGR";
+        const auto toBGRStart = std::chrono::steady_clock::now();
+        transformHSIToBGR(allColours, fastOutput, 256, "BGR", true);
+        toBGR.mpixPerSecond = 1e-6 * allColours.total() / std::chrono::duration<double>(std::chrono::steady_clock::now() - toBGRStart).count();
+        transformHSIToBGR(allColours, exactOutput, 256, "BGR", false);
+        checkFastMath(fastOutput, exactOutput, 1, toBGR);
+        results.push_back(toBGR);
+
+        EnhancementSettings exactSettings;
+        exactSettings.transformType = "AGCWHD";
+        EnhancementSettings fastSettings = exactSettings;
+        fastSettings.fastMath = true;
+        for (const std::filesystem::path& imagePath : imagePaths)
+        {
+            RegressionCase result;
+            result.name = imagePath.stem().string() + "_AGCWHD_fastMath";
+            const cv::Mat image = cv::imread(imagePath.string(), cv::IMREAD_COLOR);
+            if (image.empty())
+            {
+                result.passed = false;
+                result.note = "image could not be read";
+                results.push_back(result);
+                continue;
+            }
+            fitImageToWindow(image, 1280, 720).copyTo(fastOutput);
+            fastOutput.copyTo(exactOutput);
+            enhanceFrame(fastOutput, fastSettings, imagePath.stem().string(), false);
+            enhanceFrame(exactOutput, exactSettings, imagePath.stem().string(), false);
+            checkFastMath(fastOutput, exactOutput, 1, result);
+            results.push_back(result);
+        }
+
+        RegressionCase synthetic;
+        synthetic.name = "synthetic_AGCWHD_fastMath";
+        for (int index = 0; index < 32; index += 8)
+        {
+            makeSyntheticFrame(index).copyTo(fastOutput);
+            fastOutput.copyTo(exactOutput);
+            enhanceFrame(fastOutput, fastSettings, synthetic.name, false);
+            enhanceFrame(exactOutput, exactSettings, synthetic.name, false);
+            checkFastMath(fastOutput, exactOutput, 1, synthetic);
+        }
+        results.push_back(synthetic);
+    }
+
+    // Gain maps (every 4th pixel in both directions) against the full transformations of the sample images
+    for (const char* transformType : {"locHE", "AGCWHD"})
+    {
+        EnhancementSettings fullSettings;
+        fullSettings.transformType = transformType;
+        EnhancementSettings gainMapSettings = fullSettings;
+        gainMapSettings.gainMapScale = 4;
+        for (const std::filesystem::path& imagePath : imagePaths)
+        {
+            RegressionCase result;
+            result.name = imagePath.stem().string() + "_" + transformType + "_gainMap";
+            const cv::Mat image = cv::imread(imagePath.string(), cv::IMREAD_COLOR);
+            if (image.empty())
+            {
+                result.passed = false;
+                result.note = "image could not be read";
+                results.push_back(result);
+                continue;
+            }
+            cv::Mat fullOutput = fitImageToWindow(image, 1280, 720);
+            cv::Mat gainMapOutput = fullOutput.clone();
+            enhanceFrame(fullOutput, fullSettings, imagePath.stem().string(), false);
+            const auto start = std::chrono::steady_clock::now();
+            enhanceFrame(gainMapOutput, gainMapSettings, imagePath.stem().string(), false);
+            result.mpixPerSecond = 1e-6 * gainMapOutput.total() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            checkMeanDifference(gainMapOutput, fullOutput, 2.5, result);
+            results.push_back(result);
+        }
+    }
+
+    // Temporal denoising of a static noisy sequence has to lower the noise variance to about 1 / (previous frames + 1)
+    for (const int historyLength : {1, 4})
+    {
+        RegressionCase result;
+        result.name = "denoise_" + std::to_string(historyLength) + "_frames";
+        const cv::Mat clean(360, 640, CV_8UC3, cv::Scalar(80, 90, 100));
+        TemporalDenoiser denoiser(historyLength, 20.0);
+        cv::RNG rng(2000);
+        cv::Mat frame;
+        double inputVariance = 0.0;
+        for (int index = 0; index < 12; ++index)
+        {
+            cv::Mat noise(clean.size(), CV_16SC3);
+            rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(4));
+            cv::add(clean, noise, frame, cv::noArray(), CV_8U);
+            inputVariance = getNoiseVariance(frame, clean);
+            denoiser.apply(frame);
+        }
+        const double ratio = getNoiseVariance(frame, clean) / inputVariance;
+
+        // Ideally 1/2 and 1/5; the motion gate gives noisier previous pixels less weight, so the bounds leave room for that
+        const double maxRatio = (historyLength == 1) ? 0.7 : 0.35;
+        std::ostringstream note;
+        note << std::fixed << std::setprecision(2) << "variance ratio " << ratio;
+        result.note = note.str();
+        if (ratio > maxRatio)
+        {
+            result.passed = false;
+            result.note += " above " + std::to_string(maxRatio).substr(0, 4);
+        }
+        results.push_back(result);
+    }
+
+    // Compare the throughput with the baseline, or store it as the new one
+    for (RegressionCase& result : results)
+    {
+        const auto reference = baseline.find(toKey(result.name));
+        if (update || reference == baseline.end() || result.mpixPerSecond <= 0.0)
+        {
+            continue;
+        }
+        result.baselineMpixPerSecond = reference->second;
+        if (result.mpixPerSecond < (1.0 - allowedRegression) * reference->second)
+        {
+            result.passed = false;
+            result.note += std::string(result.note.empty() ? "" : ", ") + "throughput regressed";
+        }
+    }
+    if (update)
+    {
+        cv::FileStorage baselineFile(baselinePath.string(), cv::FileStorage::WRITE);
+        baselineFile << "threads" << threads;
+        baselineFile << "mpixPerSecond" << "{";
+        for (const RegressionCase& result : results)
+        {
+            baselineFile << toKey(result.name) << result.mpixPerSecond;
+        }
+        baselineFile << "}";
+    }
+
+    int failedCount = 0;
+    std::cout << std::left << std::setw(28) << "case" << std::right << std::setw(9) << "maxDiff" << std::setw(12) << "MPix/s"
+        << std::setw(12) << "baseline" << "  status\n";
+    for (const RegressionCase& result : results)
+    {
+        std::cout << std::left << std::setw(28) << result.name << std::right << std::setw(9) << result.maxDifference
+            << std::setw(12) << std::fixed << std::setprecision(2) << result.mpixPerSecond << std::setw(12);
+        if (result.baselineMpixPerSecond > 0.0)
+        {
+            std::cout << result.baselineMpixPerSecond;
+        }
+        else
+        {
+            std::cout << "-";
+        }
+        std::cout << "  " << (update ? "updated" : (result.passed ? "ok" : "FAILED"))
+            << (result.note.empty() ? "" : " (" + result.note + ")") << "\n";
+        if (!result.passed)
+        {
+            failedCount++;
+        }
+    }
+    std::cout << std::defaultfloat << "\n" << results.size() << " cases, " << failedCount << " failed"
+        << (update ? ", goldens and baseline saved under: " + goldenDir : "") << "\n";
+    return (failedCount > 0) ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <string>
+
+// Function to run every transform type on the images of rawImageDir and on a synthetic video stream and compare the outputs
+// with the golden images in goldenDir (within a per-transform tolerance) and the throughput with the baseline stored there
+// (failing if it drops by more than allowedRegression, e.g. 0.1 = 10%); with update, the goldens and the baseline are rewritten
+// The fastMath HSI conversions are also checked against the exact ones (identical HSI codes for every colour, at most 1 LSB on
+// every BGR output channel and on the AGCWHD output of the sample images and synthetic frames), and the locHE and AGCWHD
+// gain maps against the full transformations (mean per-channel difference of at most 2.5), and temporal denoising of a static
+// noisy sequence with 1 and 4 previous frames has to lower the noise variance, which needs no goldens
+// Returns 0 if every case passed, 1 if any failed (including cases whose golden image is missing) and -1 if the suite
+// could not run
+int runRegressionSuite(const std::string& rawImageDir, const std::string& goldenDir, const bool update, const double allowedRegression = 0.1);
+
+#endif
@@ -0,0 +1,367 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "mappedinput.h"
+#include "resultcache.h"
+
+uint64_t hashBytes(const uchar* data, const size_t size, uint64_t seed)
+{
+    // 64-bit FNV-1a over 8-byte words, followed by the MurmurHash3 finalizer to spread the bits
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t hash = (14695981039346656037ULL ^ seed) ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * prime;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb3fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool hashFileContent(const std::string& path, uint64_t& hash)
+{
+    const MappedFile file(path);
+    if (!file.isOpen())
+    {
+        return false;
+    }
+    hash = hashBytes(file.data(), file.size());
+    return true;
+}
+
+static std::string toHex(const uint64_t value)
+{
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << value;
+    return stream.str();
+}
+
+// Function to check whether a file name has the form of a cached output, <key><extension> with a 32-digit hex key
+static bool isCacheFileName(const std::string& fileName)
+{
+    const std::string stem = std::filesystem::path(fileName).stem().string();
+    return stem.size() == 32 && std::all_of(stem.begin(), stem.end(), [](unsigned char c) { return std::isxdigit(c) != 0; });
+}
+
+ResultCache::ResultCache(const std::string& cacheDir, const uint64_t maxBytes)
+    : cacheDir(cacheDir), maxBytes(maxBytes)
+{
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+    loadIndex();
+}
+
+ResultCache::~ResultCache()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (journalLines > entries.size())
+    {
+        saveIndex();
+    }
+}
+
+void ResultCache::loadIndex()
+{
+    // Index lines: <key> <bytes> <lastUsed> <fileName>, appended on every change, so a later line for a key replaces the
+    // earlier ones and a fileName of '-' marks an evicted key
+    const std::filesystem::path dir(cacheDir);
+    std::ifstream index(dir / "index.txt");
+    std::string line;
+    while (std::getline(index, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        Entry entry;
+        if (fields >> key >> entry.bytes >> entry.lastUsed >> entry.fileName)
+        {
+            journalLines++;
+            if (entry.fileName == "-")
+            {
+                entries.erase(key);
+            }
+            else
+            {
+                entries[key] = entry;
+            }
+        }
+    }
+    index.close();
+
+    // Drop entries whose files were removed behind the cache's back
+    bool compact = false;
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (std::filesystem::exists(dir / it->second.fileName))
+        {
+            ++it;
+        }
+        else
+        {
+            it = entries.erase(it);
+            compact = true;
+        }
+    }
+
+    // Remove cache files the index does not know, e.g. outputs copied in just before a crash, so they do not escape the size
+    // limit (only names of the form <32 hex digits><extension>, so other files in the directory are left alone)
+    std::unordered_map<std::string, bool> referenced;
+    for (const auto& pair : entries)
+    {
+        referenced[pair.second.fileName] = true;
+    }
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(dir, error))
+    {
+        const std::string fileName = file.path().filename().string();
+        if (isCacheFileName(fileName) && file.is_regular_file(error) && referenced.find(fileName) == referenced.end())
+        {
+            std::filesystem::remove(file.path(), error);
+        }
+    }
+
+    // Renumber the uses from 1, oldest first, so every entry has a unique stamp and new ones continue after them
+    std::vector<std::pair<int64_t, std::string>> byLastUse;
+    for (const auto& pair : entries)
+    {
+        byLastUse.emplace_back(pair.second.lastUsed, pair.first);
+    }
+    std::sort(byLastUse.begin(), byLastUse.end());
+    for (const auto& candidate : byLastUse)
+    {
+        Entry& entry = entries[candidate.second];
+        entry.lastUsed = ++useCounter;
+        useOrder[entry.lastUsed] = candidate.second;
+        totalBytes += entry.bytes;
+    }
+
+    if (compact || journalLines > entries.size())
+    {
+        saveIndex();
+    }
+    else
+    {
+        journal.open(dir / "index.txt", std::ios::app);
+    }
+    evict();
+}
+
+void ResultCache::saveIndex()
+{
+    // Write to a temporary file first, so an interrupted run never leaves a truncated index behind
+    const std::filesystem::path indexPath = std::filesystem::path(cacheDir) / "index.txt";
+    const std::filesystem::path tempPath = std::filesystem::path(cacheDir) / "index.txt.tmp";
+    journal.close();
+    {
+        std::ofstream index(tempPath, std::ios::trunc);
+        for (const auto& pair : entries)
+        {
+            index << pair.first << " " << pair.second.bytes << " " << pair.second.lastUsed << " " << pair.second.fileName << "\n";
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, indexPath, error);
+    if (error)
+    {
+        std::cerr << "Error: Cache index could not be saved: " << error.message() << "\n";
+    }
+    journalLines = entries.size();
+    journal.open(indexPath, std::ios::app);
+}
+
+void ResultCache::appendIndex(const std::string& key, const Entry* entry)
+{
+    // Flushed per line, so a crash loses at most the line being written
+    if (entry != nullptr)
+    {
+        journal << key << " " << entry->bytes << " " << entry->lastUsed << " " << entry->fileName << "\n";
+    }
+    else
+    {
+        journal << key << " 0 0 -\n";
+    }
+    journal.flush();
+    journalLines++;
+
+    // Rewrite the index once most of its lines are superseded, which keeps the appends amortized constant time
+    if (journalLines > 2 * entries.size() + 1024)
+    {
+        saveIndex();
+    }
+}
+
+void ResultCache::touch(Entry& entry, const std::string& key)
+{
+    if (entry.lastUsed > 0)
+    {
+        useOrder.erase(entry.lastUsed);
+    }
+    entry.lastUsed = ++useCounter;
+    useOrder[entry.lastUsed] = key;
+}
+
+bool ResultCache::computeKey(const std::string& rawFilePath, const std::string& mode, const EnhancementSettings& settings, std::string& key)
+{
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(rawFilePath, error);
+    if (error)
+    {
+        return false;
+    }
+    const int64_t modified = static_cast<int64_t>(std::filesystem::last_write_time(rawFilePath, error).time_since_epoch().count());
+    if (error)
+    {
+        return false;
+    }
+
+    // Hash the content only once per unchanged file
+    uint64_t contentHash = 0;
+    bool memoized = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto memo = hashMemos.find(rawFilePath);
+        if (memo != hashMemos.end() && memo->second.size == size && memo->second.modified == modified)
+        {
+            contentHash = memo->second.hash;
+            memoized = true;
+        }
+    }
+    if (!memoized)
+    {
+        if (!hashFileContent(rawFilePath, contentHash))
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        hashMemos[rawFilePath] = HashMemo{size, modified, contentHash};
+    }
+
+    std::ostringstream parameters;
+    parameters << std::setprecision(17) << mode << "|" << settings.transformType << "|" << settings.L << "|" << settings.autoQuality
+        << "|" << settings.autoTargetFps << "|" << settings.inputScale
+        << "|" << settings.clipLimit << "|" << settings.tileGridSize.width << "x" << settings.tileGridSize.height << "|" << settings.fastMath << "|" << settings.gainMapScale
+        << "|" << settings.tileSkipSize << "|" << settings.tileSkipThreshold << "|" << settings.passThroughThreshold
+        << "|" << settings.passThroughHysteresis << "|" << settings.denoiseFrames << "|" << settings.denoiseThreshold
+        << "|" << settings.yuvOutput << "|" << settings.startFrame << "|" << settings.endFrame << "|" << settings.startTime
+        << "|" << settings.endTime << "|" << settings.frameStep << "|" << settings.sampleFrames << "|" << settings.previewOutput
+        << "|" << settings.renditions;
+    const std::string parameterString = parameters.str();
+    const uint64_t parameterHash = hashBytes(reinterpret_cast<const uchar*>(parameterString.data()), parameterString.size(), contentHash);
+
+    key = toHex(contentHash) + toHex(parameterHash);
+    return true;
+}
+
+bool ResultCache::contains(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.find(key) != entries.end();
+}
+
+bool ResultCache::fetch(const std::string& key, const std::string& modFilePath)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(key);
+    if (entry == entries.end())
+    {
+        missCount++;
+        return false;
+    }
+
+    const std::filesystem::path cachedPath = std::filesystem::path(cacheDir) / entry->second.fileName;
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(modFilePath).parent_path(), error);
+
+    // If the output already is the cached file, there is nothing to do
+    if (!std::filesystem::exists(modFilePath) || !std::filesystem::equivalent(cachedPath, modFilePath, error))
+    {
+        std::filesystem::remove(modFilePath, error);
+        std::filesystem::create_hard_link(cachedPath, modFilePath, error);
+        if (error)
+        {
+            // Hard links fail across file systems, so fall back to a copy
+            error.clear();
+            std::filesystem::copy_file(cachedPath, modFilePath, std::filesystem::copy_options::overwrite_existing, error);
+            if (error)
+            {
+                missCount++;
+                return false;
+            }
+        }
+    }
+
+    touch(entry->second, key);
+    appendIndex(key, &entry->second);
+    hitCount++;
+    return true;
+}
+
+void ResultCache::store(const std::string& key, const std::string& modFilePath)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::error_code error;
+    const uint64_t bytes = std::filesystem::file_size(modFilePath, error);
+    if (error || bytes > maxBytes)
+    {
+        return;
+    }
+
+    // Copy rather than link, so rewriting the output in place can never alter the cached result
+    Entry entry;
+    entry.fileName = key + std::filesystem::path(modFilePath).extension().string();
+    entry.bytes = bytes;
+    std::filesystem::copy_file(modFilePath, std::filesystem::path(cacheDir) / entry.fileName, std::filesystem::copy_options::overwrite_existing, error);
+    if (error)
+    {
+        return;
+    }
+
+    const auto existing = entries.find(key);
+    if (existing != entries.end())
+    {
+        totalBytes -= existing->second.bytes;
+        entry.lastUsed = existing->second.lastUsed;
+    }
+    Entry& stored = entries[key];
+    stored = entry;
+    touch(stored, key);
+    totalBytes += bytes;
+    appendIndex(key, &stored);
+    evict();
+}
+
+void ResultCache::evict()
+{
+    // Remove the least recently used entries until the cache fits its size limit again
+    while (totalBytes > maxBytes && !useOrder.empty())
+    {
+        const std::string key = useOrder.begin()->second;
+        useOrder.erase(useOrder.begin());
+        const auto entry = entries.find(key);
+        if (entry == entries.end())
+        {
+            continue;
+        }
+        std::error_code error;
+        std::filesystem::remove(std::filesystem::path(cacheDir) / entry->second.fileName, error);
+        totalBytes -= entry->second.bytes;
+        entries.erase(entry);
+        appendIndex(key, nullptr);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "processor.h"
+
+// Function to compute a fast 64-bit (non-cryptographic) hash of a byte buffer
+uint64_t hashBytes(const uchar* data, const size_t size, uint64_t seed = 0);
+
+// Function to hash the content of a file through a memory mapping, returns false if the file could not be read
+bool hashFileContent(const std::string& path, uint64_t& hash);
+
+// On-disk cache of enhanced outputs, keyed by the input content, the mode, the transform type, L and all parameters
+class ResultCache
+{
+public:
+    ResultCache(const std::string& cacheDir, const uint64_t maxBytes);
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Computes the cache key of a job; the content hash is memoized per path, size and modification time
+    bool computeKey(const std::string& rawFilePath, const std::string& mode, const EnhancementSettings& settings, std::string& key);
+
+    // Returns true if an output for the key is cached
+    bool contains(const std::string& key);
+
+    // Hard-links (or copies) the cached output to modFilePath, returns false on a cache miss
+    bool fetch(const std::string& key, const std::string& modFilePath);
+
+    // Copies a freshly written output into the cache and evicts the least recently used entries beyond the size limit
+    void store(const std::string& key, const std::string& modFilePath);
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+
+private:
+    struct Entry
+    {
+        std::string fileName;
+        uint64_t bytes = 0;
+        int64_t lastUsed = 0;
+    };
+
+    struct HashMemo
+    {
+        uint64_t size = 0;
+        int64_t modified = 0;
+        uint64_t hash = 0;
+    };
+
+    void loadIndex();
+    void saveIndex();
+    void appendIndex(const std::string& key, const Entry* entry);
+    void touch(Entry& entry, const std::string& key);
+    void evict();
+
+    std::string cacheDir;
+    uint64_t maxBytes;
+    uint64_t totalBytes = 0;
+    int hitCount = 0;
+    int missCount = 0;
+    int64_t useCounter = 0;                         // Last use stamp handed out, increasing with every hit and store
+    size_t journalLines = 0;                        // Lines in the index file, compacted once mostly superseded
+    std::ofstream journal;                          // Index file, appended to on every change
+    std::unordered_map<std::string, Entry> entries;
+    std::map<int64_t, std::string> useOrder;        // Keys by last use, least recently used first
+    std::unordered_map<std::string, HashMemo> hashMemos;
+    std::mutex mutex;
+};
+
+#endif
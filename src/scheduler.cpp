@@ -0,0 +1,359 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "manifest.h"
+#include "scheduler.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Until a budget is set, OpenCV's pool keeps its default size and there is a single file and frame worker
+static ThreadBudget globalBudget;
+
+#ifdef __linux__
+// Function to read the affinity of the calling thread
+static cpu_set_t readAffinity()
+{
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    sched_getaffinity(0, sizeof(cpuSet), &cpuSet);
+    return cpuSet;
+}
+
+// Affinity of the process at startup, which the pool threads start with (instead of that of the worker creating them)
+static const cpu_set_t processAffinity = readAffinity();
+#endif
+
+ThreadBudget planThreadBudget(ThreadBudget budget)
+{
+    const int cores = std::max(1, cv::getNumberOfCPUs());
+    budget.totalThreads = (budget.totalThreads > 0) ? budget.totalThreads : cores;
+    budget.fileWorkers = std::clamp(budget.fileWorkers, 1, budget.totalThreads);
+    budget.frameWorkers = std::clamp(budget.frameWorkers, 1, std::max(1, budget.totalThreads / budget.fileWorkers));
+
+    const int outerWorkers = budget.fileWorkers * budget.frameWorkers;
+    const int remaining = std::max(1, budget.totalThreads / outerWorkers);
+    budget.intraFrameThreads = (budget.intraFrameThreads > 0) ? std::min(budget.intraFrameThreads, remaining) : remaining;
+    return budget;
+}
+
+void setThreadBudget(const ThreadBudget& budget)
+{
+    globalBudget = budget;
+    cv::setNumThreads(budget.intraFrameThreads);
+
+    // Start OpenCV's pool from the (unpinned) calling thread, so its threads do not inherit the affinity of a pinned worker
+    cv::parallel_for_(cv::Range(0, budget.intraFrameThreads), [](const cv::Range&) {});
+}
+
+const ThreadBudget& getThreadBudget()
+{
+    return globalBudget;
+}
+
+// Cores the calling thread may use (count 0 = all cores); workers of nested calls split the range of their parent
+struct CoreRange
+{
+    int first = 0;
+    int count = 0;
+};
+thread_local static CoreRange workerCores;
+
+// Function to get the slice of a core range for worker index out of count workers
+static CoreRange sliceCores(const CoreRange& parent, const int index, const int count)
+{
+    const int cores = std::max(1, cv::getNumberOfCPUs());
+    const CoreRange range = (parent.count > 0) ? parent : CoreRange{0, cores};
+    if (range.count < count)
+    {
+        // More workers than cores: the slices cannot be disjoint, so each worker gets one core of the range round-robin
+        return CoreRange{range.first + index % range.count, 1};
+    }
+    const int begin = range.first + index * range.count / count;
+    const int end = range.first + (index + 1) * range.count / count;
+    return CoreRange{begin, end - begin};
+}
+
+// Scope in which the calling thread runs as a worker on a core range, pinned to it with pinning;
+// restores the range and the affinity of the thread when it ends
+class WorkerScope
+{
+public:
+    WorkerScope(const CoreRange& cores, const bool pin) : previousCores(workerCores)
+    {
+        workerCores = cores;
+#ifdef __linux__
+        if (pin && pthread_getaffinity_np(pthread_self(), sizeof(previousMask), &previousMask) == 0)
+        {
+            const int available = std::max(1, cv::getNumberOfCPUs());
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            for (int core = cores.first; core < cores.first + cores.count; ++core)
+            {
+                CPU_SET(core % available, &cpuSet);
+            }
+            pinned = (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0);
+            if (!pinned)
+            {
+                std::cerr << "Warning: Worker could not be pinned to its cores." << "\n";
+            }
+        }
+#else
+        (void)pin;
+#endif
+    }
+
+    ~WorkerScope()
+    {
+        workerCores = previousCores;
+#ifdef __linux__
+        if (pinned)
+        {
+            pthread_setaffinity_np(pthread_self(), sizeof(previousMask), &previousMask);
+        }
+#endif
+    }
+
+    WorkerScope(const WorkerScope&) = delete;
+    WorkerScope& operator=(const WorkerScope&) = delete;
+
+private:
+    CoreRange previousCores;
+    bool pinned = false;
+#ifdef __linux__
+    cpu_set_t previousMask;
+#endif
+};
+
+// Tasks of one call of runConcurrently; indices are claimed by the caller and the pool threads alike
+struct TaskBatch
+{
+    const std::function<void(int)>* task = nullptr;
+    CoreRange parentCores;
+    int count = 0;
+    bool pin = false;
+    std::atomic<int> nextIndex{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    int completed = 0;
+    std::exception_ptr error;
+};
+
+// Function to claim and run the next index of a batch; returns false when all indices are claimed
+static bool runNextTask(TaskBatch& batch)
+{
+    const int index = batch.nextIndex.fetch_add(1);
+    if (index >= batch.count)
+    {
+        return false;
+    }
+
+    std::exception_ptr error;
+    {
+        WorkerScope scope(sliceCores(batch.parentCores, index, batch.count), batch.pin);
+        try
+        {
+            (*batch.task)(index);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (error && !batch.error)
+    {
+        batch.error = error;
+    }
+    if (++batch.completed == batch.count)
+    {
+        batch.finished.notify_all();
+    }
+    return true;
+}
+
+// Persistent threads that help with the batches of runConcurrently; the pool grows until every queued batch
+// has an idle thread (a batch never waits for the pool, its caller runs whatever no pool thread has claimed)
+class WorkerPool
+{
+public:
+    static WorkerPool& instance()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    void submit(const std::shared_ptr<TaskBatch>& batch, const int helpers)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int helper = 0; helper < helpers; ++helper)
+        {
+            queue.push_back(batch);
+        }
+        while (idleThreads < static_cast<int>(queue.size()))
+        {
+            threads.emplace_back(&WorkerPool::runThread, this);
+            ++idleThreads;
+        }
+        available.notify_all();
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    WorkerPool() = default;
+
+    void runThread()
+    {
+#ifdef __linux__
+        pthread_setaffinity_np(pthread_self(), sizeof(processAffinity), &processAffinity);
+#endif
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            available.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+            const std::shared_ptr<TaskBatch> batch = queue.front();
+            queue.pop_front();
+            --idleThreads;
+            lock.unlock();
+            while (runNextTask(*batch))
+            {
+            }
+            lock.lock();
+            ++idleThreads;
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::shared_ptr<TaskBatch>> queue;
+    std::vector<std::thread> threads;
+    int idleThreads = 0;
+    bool stopping = false;
+};
+
+void runConcurrently(const int count, const std::function<void(int)>& task)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    const auto batch = std::make_shared<TaskBatch>();
+    batch->task = &task;
+    batch->parentCores = workerCores;
+    batch->count = count;
+    batch->pin = globalBudget.pinThreads;
+    if (count > 1)
+    {
+        WorkerPool::instance().submit(batch, count - 1);
+    }
+
+    // The caller works on its own batch, too, so nested calls finish even when all pool threads are busy
+    while (runNextTask(*batch))
+    {
+    }
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&batch] { return batch->completed == batch->count; });
+    if (batch->error)
+    {
+        std::rethrow_exception(batch->error);
+    }
+}
+
+int runThreadBenchmark(const std::string& manifestPath, const int totalThreads, const int repeat)
+{
+    Manifest manifest;
+    if (!readManifest(manifestPath, manifest))
+    {
+        return -1;
+    }
+
+    // Malformed jobs are left out, so every split runs the same valid jobs
+    std::vector<JobSpec> jobs;
+    for (size_t index = 0; index < manifest.jobs.size(); ++index)
+    {
+        if (manifest.jobErrors[index].empty())
+        {
+            jobs.push_back(manifest.jobs[index]);
+            jobs.back().verbose = false;
+        }
+    }
+    const ThreadBudget& manifestBudget = manifest.budget;
+
+    ThreadBudget base;
+    base.totalThreads = totalThreads;
+    base.pinThreads = manifestBudget.pinThreads;
+    base = planThreadBudget(base);
+
+    std::cout << "Benchmarking " << jobs.size() << " jobs with a budget of " << base.totalThreads << " threads"
+        << (base.pinThreads ? " (pinned)" : "") << "\n\n"
+        << "fileWorkers  frameWorkers  intraFrameThreads  seconds     jobs/s\n";
+
+    // Try every power-of-two split of the budget (the result cache stays disabled, so every run does the full work)
+    ThreadBudget best = base;
+    double bestSeconds = -1.0;
+    for (int fileWorkers = 1; fileWorkers <= base.totalThreads; fileWorkers *= 2)
+    {
+        for (int frameWorkers = 1; fileWorkers * frameWorkers <= base.totalThreads; frameWorkers *= 2)
+        {
+            ThreadBudget split = base;
+            split.fileWorkers = fileWorkers;
+            split.frameWorkers = frameWorkers;
+            split.intraFrameThreads = 0;
+            split = planThreadBudget(split);
+            setThreadBudget(split);
+
+            double seconds = -1.0;
+            int failedCount = 0;
+            for (int run = 0; run < std::max(1, repeat); ++run)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                failedCount = runJobList(jobs, nullptr, false);
+                const double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                seconds = (seconds < 0.0) ? runSeconds : std::min(seconds, runSeconds);
+            }
+
+            std::cout << std::setw(11) << split.fileWorkers << "  " << std::setw(12) << split.frameWorkers << "  "
+                << std::setw(17) << split.intraFrameThreads << "  " << std::setw(8) << std::fixed << std::setprecision(3) << seconds
+                << "  " << std::setw(9) << jobs.size() / seconds << (failedCount > 0 ? "  (" + std::to_string(failedCount) + " failed)" : "") << "\n";
+            if (bestSeconds < 0.0 || seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+                best = split;
+            }
+        }
+    }
+
+    std::cout << "\n" << "Best split: fileWorkers " << best.fileWorkers << ", frameWorkers " << best.frameWorkers
+        << ", intraFrameThreads " << best.intraFrameThreads << "\n";
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <functional>
+#include <string>
+
+// Split of the global thread budget between file-level, frame-level and intra-frame parallelism
+struct ThreadBudget
+{
+    int totalThreads = 0;                       // global thread budget (0 = number of cores)
+    int fileWorkers = 1;                        // files processed concurrently (manifest and daemon)
+    int frameWorkers = 1;                       // frames of a video enhanced concurrently
+    int intraFrameThreads = 0;                  // threads of OpenCV's pool within a frame (0 = the rest of the budget)
+    bool pinThreads = false;                    // pin the file/frame workers to disjoint sets of cores (Linux only)
+};
+
+// Function to complete a thread budget, so that file workers x frame workers x intra-frame threads fit into the total
+ThreadBudget planThreadBudget(ThreadBudget budget);
+
+// Function to make a (planned) budget the global one and size OpenCV's thread pool for it
+void setThreadBudget(const ThreadBudget& budget);
+
+// Function to get the global thread budget
+const ThreadBudget& getThreadBudget();
+
+// Function to run task(0) ... task(count - 1) concurrently on the calling thread and persistent pool threads
+// (with pinning, every worker is pinned to its own slice of the cores while it runs, nested calls split the slice of
+// their parent; an exception of a task is rethrown on the calling thread)
+void runConcurrently(const int count, const std::function<void(int)>& task);
+
+// Function to run the jobs of a manifest with every split of the thread budget and print the throughput of each
+int runThreadBenchmark(const std::string& manifestPath, const int totalThreads = 0, const int repeat = 1);
+
+#endif
@@ -0,0 +1,312 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include "utils.h"
+#include "tileskip.h"
+
+std::vector<bool> classifyBrightTiles(const cv::Mat& frame, const int tileSize, const double threshold, const int L, int& tileRows, int& tileCols)
+{
+    tileRows = (frame.rows + tileSize - 1) / tileSize;
+    tileCols = (frame.cols + tileSize - 1) / tileSize;
+    std::vector<bool> bright(static_cast<size_t>(tileRows) * tileCols, false);
+
+    // Sample a sparse grid of about 16 x 16 pixels per tile
+    const int step = std::max(1, tileSize / 16);
+    const double maxThreshold = 0.75 * (L - 1);
+
+    for (int ty = 0; ty < tileRows; ++ty)
+    {
+        for (int tx = 0; tx < tileCols; ++tx)
+        {
+            const int yEnd = std::min(frame.rows, (ty + 1) * tileSize);
+            const int xEnd = std::min(frame.cols, (tx + 1) * tileSize);
+            double sum = 0.0;
+            int maxIntensity = 0;
+            int count = 0;
+            for (int y = ty * tileSize; y < yEnd; y += step)
+            {
+                const cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+                for (int x = tx * tileSize; x < xEnd; x += step)
+                {
+                    const int intensity = (row[x][0] + row[x][1] + row[x][2]) / 3;
+                    sum += intensity;
+                    maxIntensity = std::max(maxIntensity, intensity);
+                    count++;
+                }
+            }
+
+            // Bright tiles are well exposed on average and already reach into the upper intensity range
+            const double mean = sum / std::max(1, count);
+            bright[static_cast<size_t>(ty) * tileCols + tx] = (mean >= threshold && maxIntensity >= maxThreshold);
+        }
+    }
+    return bright;
+}
+
+// Function to compute the per-channel histograms of a frame in one parallel pass
+static std::vector<std::vector<int>> computeChannelHists(const cv::Mat& frame)
+{
+    std::vector<std::vector<int>> hists(3, std::vector<int>(256, 0));
+    std::mutex mergeMutex;
+    cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& range)
+    {
+        std::vector<std::vector<int>> localHists(3, std::vector<int>(256, 0));
+        for (int y = range.start; y < range.end; ++y)
+        {
+            const cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < frame.cols; ++x)
+            {
+                localHists[0][row[x][0]]++;
+                localHists[1][row[x][1]]++;
+                localHists[2][row[x][2]]++;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        for (int c = 0; c < 3; ++c)
+        {
+            for (int value = 0; value < 256; ++value)
+            {
+                hists[c][value] += localHists[c][value];
+            }
+        }
+    });
+    return hists;
+}
+
+// Function to compute the HSI intensity histogram of the stretched frame without stretching it or computing hue and saturation
+static std::vector<int> computeStretchedIntensityHist(const cv::Mat& frame, const cv::Mat& stretchLut, const int L)
+{
+    const int maxL = L - 1;
+    const double invMaxLim = 1.0 / maxL;
+    const uchar* lut = stretchLut.ptr<uchar>(0);
+
+    std::vector<int> hist(std::max(L, 256), 0);
+    std::mutex mergeMutex;
+    cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& range)
+    {
+        std::vector<int> localHist(hist.size(), 0);
+        for (int y = range.start; y < range.end; ++y)
+        {
+            const cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < frame.cols; ++x)
+            {
+                const uchar b = lut[row[x][0] * 3 + 0];
+                const uchar g = lut[row[x][1] * 3 + 1];
+                const uchar r = lut[row[x][2] * 3 + 2];
+
+                // Same arithmetic as the intensity in transformBGRToHSI (exact and fastMath), so the codes match the full-frame path exactly
+                const double BGRsum = b * invMaxLim + g * invMaxLim + r * invMaxLim;
+                localHist[static_cast<uchar>(BGRsum / 3.0 * maxL)]++;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        for (size_t value = 0; value < hist.size(); ++value)
+        {
+            hist[value] += localHist[value];
+        }
+    });
+    return hist;
+}
+
+// Function to compute the weight of the enhanced pixel at (x, y) of a tile, ramping down towards bright neighbours
+static float computeBlendWeight(const int x, const int y, const int width, const int height, const bool brightNeighbour[3][3], const float margin)
+{
+    float weight = 1.0f;
+    const auto ramp = [&weight, margin](const int distance) { weight = std::min(weight, (distance + 0.5f) / margin); };
+
+    if (brightNeighbour[1][0]) ramp(x);
+    if (brightNeighbour[1][2]) ramp(width - 1 - x);
+    if (brightNeighbour[0][1]) ramp(y);
+    if (brightNeighbour[2][1]) ramp(height - 1 - y);
+    if (brightNeighbour[0][0]) ramp(std::max(x, y));
+    if (brightNeighbour[0][2]) ramp(std::max(width - 1 - x, y));
+    if (brightNeighbour[2][0]) ramp(std::max(x, height - 1 - y));
+    if (brightNeighbour[2][2]) ramp(std::max(width - 1 - x, height - 1 - y));
+    return weight;
+}
+
+double enhanceFrameTiled(
+    cv::Mat& frame, const EnhancementSettings& settings, const std::string& fileName, const bool plotHistograms,
+    const bool verbose, const std::string& histDir, const std::string& file, TransformScratch* scratch)
+{
+    EnhancementSettings fullFrameSettings = settings;
+    fullFrameSettings.tileSkipSize = 0;
+
+    const int tileSize = settings.tileSkipSize;
+    int tileRows, tileCols;
+    const std::vector<bool> bright = classifyBrightTiles(frame, tileSize, settings.tileSkipThreshold, settings.L, tileRows, tileCols);
+    const size_t brightCount = std::count(bright.begin(), bright.end(), true);
+
+    if (brightCount == bright.size())
+    {
+        return 1.0;
+    }
+
+    // Without bright tiles there is nothing to skip, and CLAHE is not a per-pixel mapping, so both take the full-frame path
+    if (brightCount == 0 || settings.transformType == "locHE")
+    {
+        enhanceFrame(frame, fullFrameSettings, fileName, plotHistograms, verbose, histDir, file, scratch);
+        return 0.0;
+    }
+
+    // The mappings are derived from the whole frame, so the enhanced dark tiles equal the full-frame result
+    // (without buffers of the caller, the statistics and the stretch lookup table only live for this call)
+    TransformScratch localScratch;
+    scratch = (scratch != nullptr) ? scratch : &localScratch;
+    FrameStats& stats = scratch->stats;
+    computeFrameStats(frame, stats, settings.L);
+    computeStretchLUT(stats, 0, settings.L, scratch->stretchLUT);
+    const cv::Mat& stretchLut = scratch->stretchLUT;
+
+    cv::Mat combinedLut;
+    cv::Mat gammaLut;
+    if (settings.transformType == "log")
+    {
+        const cv::Mat logLut = computeLogLUT(stats, settings.inputScale, settings.L);
+        cv::LUT(stretchLut, logLut, combinedLut);
+    }
+    else if (settings.transformType == "globHE")
+    {
+        // Histograms of the stretched channels, derived from the raw ones through the stretch lookup table
+        const std::vector<std::vector<int>> rawHists = computeChannelHists(frame);
+        const uchar* stretch = stretchLut.ptr<uchar>(0);
+        combinedLut.create(1, 256, CV_8UC3);
+        for (int c = 0; c < 3; ++c)
+        {
+            std::vector<int> stretchedHist(256, 0);
+            for (int value = 0; value < 256; ++value)
+            {
+                stretchedHist[stretch[value * 3 + c]] += rawHists[c][value];
+            }
+            const cv::Mat equalizeLut = computeEqualizeLUT(stretchedHist);
+            for (int value = 0; value < 256; ++value)
+            {
+                combinedLut.ptr<uchar>(0)[value * 3 + c] = equalizeLut.at<uchar>(0, stretch[value * 3 + c]);
+            }
+        }
+    }
+    else if (settings.transformType == "AGCWHD")
+    {
+        const std::vector<int> intensityHist = computeStretchedIntensityHist(frame, stretchLut, settings.L);
+        std::map<double, int> channelHist;
+        double cMax = 0.0;
+        for (int value = 0; value < static_cast<int>(intensityHist.size()); ++value)
+        {
+            if (value < settings.L || intensityHist[value] > 0)
+            {
+                channelHist[value] = intensityHist[value];
+            }
+            if (intensityHist[value] > 0)
+            {
+                cMax = value;
+            }
+        }
+        gammaLut = computeGammaLUT(computeAGCWHDGamma(channelHist, settings.L, cMax, verbose), cMax);
+
+        // The histograms are those of the whole stretched frame, as on the full-frame path
+        if (plotHistograms && !histDir.empty() && !file.empty())
+        {
+            plotAGCWHDHistograms(channelHist, gammaLut, settings.L, fileName, histDir, file, verbose);
+        }
+    }
+    else
+    {
+        return 0.0;
+    }
+
+    std::vector<cv::Point> darkTiles;
+    for (int ty = 0; ty < tileRows; ++ty)
+    {
+        for (int tx = 0; tx < tileCols; ++tx)
+        {
+            if (!bright[static_cast<size_t>(ty) * tileCols + tx])
+            {
+                darkTiles.emplace_back(tx, ty);
+            }
+        }
+    }
+
+    const float margin = std::max(1.0f, tileSize / 4.0f);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(darkTiles.size())), [&](const cv::Range& range)
+    {
+        for (int t = range.start; t < range.end; ++t)
+        {
+            const int tx = darkTiles[t].x;
+            const int ty = darkTiles[t].y;
+            const cv::Rect rect(tx * tileSize, ty * tileSize,
+                std::min(tileSize, frame.cols - tx * tileSize), std::min(tileSize, frame.rows - ty * tileSize));
+            cv::Mat tile = frame(rect);
+
+            // Enhance the tile with the frame-wide mappings
+            cv::Mat enhanced;
+            if (!combinedLut.empty())
+            {
+                cv::LUT(tile, combinedLut, enhanced);
+            }
+            else
+            {
+                cv::Mat stretched;
+                cv::LUT(tile, stretchLut, stretched);
+                cv::Mat hsiTile = transformBGRToHSI(stretched, settings.L, "BGR", settings.fastMath);
+                std::vector<cv::Mat> hsiChannels;
+                cv::split(hsiTile, hsiChannels);
+                cv::LUT(hsiChannels[0], gammaLut, hsiChannels[0]);
+                cv::merge(hsiChannels, hsiTile);
+                enhanced = transformHSIToBGR(hsiTile, settings.L, "BGR", settings.fastMath);
+            }
+
+            // Find the bright neighbours (tiles outside the frame do not count)
+            bool brightNeighbour[3][3] = {};
+            bool anyBrightNeighbour = false;
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    const int ny = ty + dy;
+                    const int nx = tx + dx;
+                    if ((dx != 0 || dy != 0) && ny >= 0 && ny < tileRows && nx >= 0 && nx < tileCols && bright[static_cast<size_t>(ny) * tileCols + nx])
+                    {
+                        brightNeighbour[dy + 1][dx + 1] = true;
+                        anyBrightNeighbour = true;
+                    }
+                }
+            }
+
+            if (!anyBrightNeighbour)
+            {
+                enhanced.copyTo(tile);
+                continue;
+            }
+
+            // Blend towards the unchanged bright neighbours, so no seams appear at the tile borders
+            for (int y = 0; y < rect.height; ++y)
+            {
+                cv::Vec3b* original = tile.ptr<cv::Vec3b>(y);
+                const cv::Vec3b* transformed = enhanced.ptr<cv::Vec3b>(y);
+                for (int x = 0; x < rect.width; ++x)
+                {
+                    const float weight = computeBlendWeight(x, y, rect.width, rect.height, brightNeighbour, margin);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        original[x][c] = cv::saturate_cast<uchar>(original[x][c] + weight * (transformed[x][c] - original[x][c]));
+                    }
+                }
+            }
+        }
+    });
+
+    // Report the share of pixels in bright tiles, which were passed through without any work
+    int skippedPixels = 0;
+    for (int ty = 0; ty < tileRows; ++ty)
+    {
+        for (int tx = 0; tx < tileCols; ++tx)
+        {
+            if (bright[static_cast<size_t>(ty) * tileCols + tx])
+            {
+                skippedPixels += std::min(tileSize, frame.cols - tx * tileSize) * std::min(tileSize, frame.rows - ty * tileSize);
+            }
+        }
+    }
+    return static_cast<double>(skippedPixels) / (static_cast<double>(frame.rows) * frame.cols);
+}
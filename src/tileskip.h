@@ -0,0 +1,18 @@
+#ifndef TILE_SKIP_H
+#define TILE_SKIP_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "processor.h"
+
+// Function to classify the tiles of a frame by a sampled mean/max of the intensity, returns one flag per tile (true = bright)
+std::vector<bool> classifyBrightTiles(const cv::Mat& frame, const int tileSize, const double threshold, const int L, int& tileRows, int& tileCols);
+
+// Function to enhance only the dark tiles of a frame, with the parameters of the whole frame and blended tile borders
+// Bright tiles are passed through unchanged; returns the fraction of pixels that were skipped
+// (the histogram plotting and scratch parameters are those of enhanceFrame; frames taking the full-frame path pass them on)
+double enhanceFrameTiled(
+    cv::Mat& frame, const EnhancementSettings& settings, const std::string& fileName = "", const bool plotHistograms = false,
+    const bool verbose = false, const std::string& histDir = "", const std::string& file = "", TransformScratch* scratch = nullptr);
+
+#endif
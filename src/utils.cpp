@@ -6,7 +6,11 @@
 #include <map>
 #include <vector>
 #include <limits>
+#include <tuple>
+#include <mutex>
+#include <algorithm>
 #include "utils.h"
+#include "perfcounters.h"
 
 void createDirectory(const std::string pathString)
 {
@@ -80,87 +84,248 @@ cv::Mat fitImageToWindow(const cv::Mat& image, int windowMaxWidth, int windowMax
     return resizedImage;
 }
 
-void stretchColorChannels(const cv::Mat& image, const int minL, const int L)
+void computeFrameStats(const cv::Mat& image, FrameStats& stats, const int L, const int histChannel)
+{
+    CV_Assert(image.depth() == CV_8U);
+    const int channels = image.channels();
+    const int histSize = std::max(L, 256);
+    const bool withHist = (histChannel >= 0 && histChannel < channels);
+
+    stats.channelMin.assign(channels, std::numeric_limits<double>::max());
+    stats.channelMax.assign(channels, std::numeric_limits<double>::lowest());
+    stats.hist.assign(withHist ? histSize : 0, 0);
+    stats.histChannelMax = 0.0;
+
+    // Each stripe of rows collects its own min/max and histogram, which are merged at the end of the stripe
+    std::mutex mergeMutex;
+    const int stripes = std::max(1, std::min(image.rows, cv::getNumThreads() * 4));
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& range)
+    {
+        std::vector<uchar> localMin(channels, 255);
+        std::vector<uchar> localMax(channels, 0);
+        std::vector<int> localHist(withHist ? histSize : 0, 0);
+
+        // Min/max over blocks of 48 bytes, so the inner loop has a fixed length the compiler vectorizes; 48 is a multiple
+        // of 1 to 4 channels (e.g. 16 BGR pixels), so byte j of every block belongs to channel j % channels
+        constexpr int blockSize = 48;
+        uchar blockMin[blockSize];
+        uchar blockMax[blockSize];
+        std::fill(blockMin, blockMin + blockSize, static_cast<uchar>(255));
+        std::fill(blockMax, blockMax + blockSize, static_cast<uchar>(0));
+        const int rowBytes = image.cols * channels;
+        const int blockBytes = (blockSize % channels == 0) ? (rowBytes / blockSize) * blockSize : 0;
+
+        for (int row = range.start; row < range.end; ++row)
+        {
+            const uchar* data = image.ptr<uchar>(row);
+            for (int i = 0; i < blockBytes; i += blockSize)
+            {
+                for (int j = 0; j < blockSize; ++j)
+                {
+                    // Compared by value, std::min/std::max return references the vectorizer treats as possible aliases
+                    const uchar value = data[i + j];
+                    blockMin[j] = (value < blockMin[j]) ? value : blockMin[j];
+                    blockMax[j] = (value > blockMax[j]) ? value : blockMax[j];
+                }
+            }
+            for (int i = blockBytes; i < rowBytes; ++i)
+            {
+                localMin[i % channels] = std::min(localMin[i % channels], data[i]);
+                localMax[i % channels] = std::max(localMax[i % channels], data[i]);
+            }
+            if (withHist)
+            {
+                for (int i = histChannel; i < rowBytes; i += channels)
+                {
+                    localHist[data[i]]++;
+                }
+            }
+        }
+        if (blockBytes > 0)
+        {
+            for (int j = 0; j < blockSize; ++j)
+            {
+                localMin[j % channels] = std::min(localMin[j % channels], blockMin[j]);
+                localMax[j % channels] = std::max(localMax[j % channels], blockMax[j]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        for (int c = 0; c < channels; ++c)
+        {
+            stats.channelMin[c] = std::min(stats.channelMin[c], static_cast<double>(localMin[c]));
+            stats.channelMax[c] = std::max(stats.channelMax[c], static_cast<double>(localMax[c]));
+        }
+        for (size_t value = 0; value < localHist.size(); ++value)
+        {
+            stats.hist[value] += localHist[value];
+        }
+    }, stripes);
+
+    if (withHist)
+    {
+        stats.histChannelMax = stats.channelMax[histChannel];
+    }
+}
+
+cv::Mat computeStretchLUT(FrameStats& stats, const int minL, const int L)
+{
+    cv::Mat lut;
+    computeStretchLUT(stats, minL, L, lut);
+    return lut;
+}
+
+void computeStretchLUT(FrameStats& stats, const int minL, const int L, cv::Mat& lut)
 {
     const int maxL = L - 1;
-    
-    // Loop through each channel
-    std::vector<cv::Mat> channels;
-    cv::split(image, channels);
+    const int channels = static_cast<int>(stats.channelMin.size());
 
-    for (cv::Mat& channel : channels)
+    // One lookup table entry per channel and value, following the stretching formula
+    lut.create(1, 256, CV_8UC(channels));
+    for (int c = 0; c < channels; ++c)
     {
-        // find empirical min and max pixel values
-        double minVal, maxVal;
-        cv::minMaxLoc(channel, &minVal, &maxVal);
+        const double minVal = stats.channelMin[c];
+        const double maxVal = stats.channelMax[c];
         const double valRange = maxVal - minVal;
-
-        // Stretch the channel
-        for (int y = 0; y < image.rows; ++y)
+        for (int oldVal = 0; oldVal < 256; ++oldVal)
         {
-            for (int x = 0; x < image.cols; ++x)
+            uchar newVal = static_cast<uchar>(oldVal);
+            if (valRange > 0 && oldVal >= minVal && oldVal <= maxVal)
             {
-                // Apply stretching formula
-                const uchar oldVal = channel.at<uchar>(y, x);
-                const uchar newVal = static_cast<uchar>((oldVal - minVal) * (maxL - minL) / valRange + minL);
-                channel.at<uchar>(y, x) = newVal;
+                newVal = static_cast<uchar>((oldVal - minVal) * (maxL - minL) / valRange + minL);
             }
+            lut.ptr<uchar>(0)[oldVal * channels + c] = newVal;
         }
+
+        // The stretching is monotonic, so the new extrema are the stretched old ones
+        stats.channelMin[c] = lut.ptr<uchar>(0)[static_cast<int>(minVal) * channels + c];
+        stats.channelMax[c] = lut.ptr<uchar>(0)[static_cast<int>(maxVal) * channels + c];
     }
-    
-    // Merge the modified channels back together
-    cv::merge(channels, image);
+    stats.hist.clear();
+}
+
+void stretchColorChannels(const cv::Mat& image, const int minL, const int L, FrameStats* stats, cv::Mat* lut)
+{
+    // Gather the empirical min and max pixel values of all channels in one pass, unless they are provided
+    FrameStats localStats;
+    if (stats == nullptr)
+    {
+        computeFrameStats(image, localStats, L);
+        stats = &localStats;
+    }
+
+    // Apply the lookup tables of all channels in a single pass
+    cv::Mat localLut;
+    lut = (lut != nullptr) ? lut : &localLut;
+    computeStretchLUT(*stats, minL, L, *lut);
+    cv::LUT(image, *lut, image);
+}
+
+cv::Mat computeLogLUT(const FrameStats& stats, const double inputScale, const int L)
+{
+    cv::Mat lut;
+    computeLogLUT(stats, inputScale, L, lut);
+    return lut;
 }
 
-void transformLogarithmic(const cv::Mat& image, const double inputScale, const int L)
+void computeLogLUT(const FrameStats& stats, const double inputScale, const int L, cv::Mat& lut)
 {
     const int maxL = L - 1;
-    
-    // Loop through each channel
-    std::vector<cv::Mat> channels;
-    cv::split(image, channels);
+    const int channels = static_cast<int>(stats.channelMax.size());
 
-    for (cv::Mat& channel : channels)
+    lut.create(1, 256, CV_8UC(channels));
+    for (int c = 0; c < channels; ++c)
     {
-        // Find empirical min and max pixel values
-        double minVal, maxVal;
-        cv::minMaxLoc(channel, &minVal, &maxVal);
-
         // Compute the output scale factor
+        const double maxVal = stats.channelMax[c];
         const double outputScale = maxL / (log(1 + maxVal));
 
-        // Apply log transformation
-        for (int y = 0; y < image.rows; ++y)
+        for (int oldVal = 0; oldVal < 256; ++oldVal)
         {
-            for (int x = 0; x < image.cols; ++x)
-            {
-                const uchar oldVal = channel.at<uchar>(y, x);
-                const uchar newVal = static_cast<uchar>(outputScale * log(1 + (exp(inputScale) - 1) * oldVal));
-                channel.at<uchar>(y, x) = newVal;
-            }
+            const int clampedVal = std::min(oldVal, static_cast<int>(maxVal));
+            lut.ptr<uchar>(0)[oldVal * channels + c] = static_cast<uchar>(outputScale * log(1 + (exp(inputScale) - 1) * clampedVal));
         }
     }
-    // Merge the modified channels back together
-    cv::merge(channels, image);
 }
 
-void transformHistEqual(const cv::Mat& image, const double clipLimit, const cv::Size& tileGridSize, const std::string& equalType)
+void transformLogarithmic(const cv::Mat& image, const double inputScale, const int L, const FrameStats* stats, cv::Mat* lut)
+{
+    // Find empirical max pixel values, unless they are provided
+    FrameStats localStats;
+    if (stats == nullptr)
+    {
+        computeFrameStats(image, localStats, L);
+        stats = &localStats;
+    }
+
+    // Apply the lookup tables of all channels in a single pass
+    cv::Mat localLut;
+    lut = (lut != nullptr) ? lut : &localLut;
+    computeLogLUT(*stats, inputScale, L, *lut);
+    cv::LUT(image, *lut, image);
+}
+
+cv::Mat computeEqualizeLUT(const std::vector<int>& hist)
+{
+    // Same mapping as cv::equalizeHist: the normalized CDF, starting at the first occupied bin
+    cv::Mat lut(1, 256, CV_8U, cv::Scalar(0));
+    uchar* lutData = lut.ptr<uchar>(0);
+    int total = 0;
+    for (int value = 0; value < 256; ++value)
+    {
+        total += hist[value];
+    }
+    int first = 0;
+    while (first < 255 && hist[first] == 0)
+    {
+        ++first;
+    }
+    if (hist[first] == total)
+    {
+        lut.setTo(cv::Scalar(first));
+        return lut;
+    }
+
+    const float scale = (256 - 1.f) / (total - hist[first]);
+    int sum = 0;
+    for (int value = first + 1; value < 256; ++value)
+    {
+        sum += hist[value];
+        lutData[value] = cv::saturate_cast<uchar>(sum * scale);
+    }
+    return lut;
+}
+
+cv::Ptr<cv::CLAHE> getCLAHE(const double clipLimit, const cv::Size& tileGridSize)
+{
+    // CLAHE objects keep internal buffers, so they are cached per thread and per parameter set
+    thread_local std::map<std::tuple<double, int, int>, cv::Ptr<cv::CLAHE>> claheCache;
+    cv::Ptr<cv::CLAHE>& clahe = claheCache[std::make_tuple(clipLimit, tileGridSize.width, tileGridSize.height)];
+    if (clahe.empty())
+    {
+        clahe = cv::createCLAHE(clipLimit, tileGridSize);
+    }
+    return clahe;
+}
+
+void transformHistEqual(const cv::Mat& image, const double clipLimit, const cv::Size& tileGridSize, const std::string& equalType, std::vector<cv::Mat>* channels)
 {
     // Apply channel-wise
-    std::vector<cv::Mat> channels;
-    split(image, channels);
+    std::vector<cv::Mat> localChannels;
+    channels = (channels != nullptr) ? channels : &localChannels;
+    split(image, *channels);
 
     if (equalType == "local")
     {
-        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(clipLimit, tileGridSize);
-        for (cv::Mat& channel : channels)
+        cv::Ptr<cv::CLAHE> clahe = getCLAHE(clipLimit, tileGridSize);
+        for (cv::Mat& channel : *channels)
         {
             clahe->apply(channel, channel);
         }
     }
     else if (equalType == "global")
     {
-        for (cv::Mat& channel : channels)
+        for (cv::Mat& channel : *channels)
         {
             cv::equalizeHist(channel, channel);
         }
@@ -170,11 +335,87 @@ void transformHistEqual(const cv::Mat& image, const double clipLimit, const cv::
         std::cerr << "Error: Invalid equalType value. Use 'local' or 'global'.\n";
     }
     // Merge the modified channels back together
-    cv::merge(channels, image);
+    cv::merge(*channels, image);
 }
 
-cv::Mat transformBGRToHSI(const cv::Mat& image, const int L, const std::string& outputScaleType)
+// Approximate acos(x) with the minimax polynomial from Abramowitz & Stegun (4.4.45), |error| <= 5e-5 rad
+static inline double fastAcos(const double x)
+{
+    const double absX = std::fabs(x);
+    const double poly = ((-0.0187293 * absX + 0.0742610) * absX - 0.2121144) * absX + 1.5707288;
+    const double result = poly * std::sqrt(std::max(0.0, 1.0 - absX));
+    return (x < 0.0) ? CV_PI - result : result;
+}
+
+static void transformBGRToHSIFast(const cv::Mat& image, cv::Mat& hsiImage, const int L, const bool normalized)
+{
+    const int maxL = L - 1;
+    const int rows = image.rows;
+    const int cols = image.cols;
+    const double eps = 1e-6;
+    const double invMaxLim = 1.0 / maxL;
+
+    // The polynomial is off by at most 5e-5 rad (0.002 hue codes for L = 256), so only hues this close to a code boundary
+    // can truncate differently; those are recomputed with std::acos, which keeps every 8-bit code identical to the exact path
+    const double boundaryMargin = 0.01;
+
+    hsiImage.create(rows, cols, normalized ? CV_64FC3 : CV_8UC3);
+
+    for (int row = 0; row < rows; ++row)
+    {
+        const cv::Vec3b* srcRow = image.ptr<cv::Vec3b>(row);
+        for (int col = 0; col < cols; ++col)
+        {
+            const double b = srcRow[col][0] * invMaxLim;
+            const double g = srcRow[col][1] * invMaxLim;
+            const double r = srcRow[col][2] * invMaxLim;
+
+            const double BGRsum = b + g + r;
+            const double minVal = std::min(b, std::min(g, r));
+
+            // Hue, normalized to [0, 1]
+            const double cosTheta = (0.5 * ((r - g) + (r - b))) / (std::sqrt((r - g) * (r - g) + (r - b) * (g - b)) + eps);
+            const double theta = fastAcos(cosTheta);
+            double h = ((b <= g) ? theta : (2 * CV_PI - theta)) / (2 * CV_PI);
+            if (!normalized && std::abs(h * maxL - std::round(h * maxL)) < boundaryMargin)
+            {
+                const double exactTheta = std::acos(cosTheta);
+                h = ((b <= g) ? exactTheta : (2 * CV_PI - exactTheta)) * 180.0 / CV_PI / 360.0;
+            }
+
+            // Intensity
+            const double i = BGRsum / 3.0;
+
+            // Saturation
+            const double s = 1 - (3.0 * minVal / (BGRsum + eps));
+
+            if (normalized)
+            {
+                hsiImage.at<cv::Vec3d>(row, col) = cv::Vec3d(i, s, h);
+            }
+            else
+            {
+                hsiImage.at<cv::Vec3b>(row, col) = cv::Vec3b(static_cast<uchar>(i * maxL), static_cast<uchar>(s * maxL), static_cast<uchar>(h * maxL));
+            }
+        }
+    }
+}
+
+cv::Mat transformBGRToHSI(const cv::Mat& image, const int L, const std::string& outputScaleType, const bool fastMath)
+{
+    cv::Mat hsiImage;
+    transformBGRToHSI(image, hsiImage, L, outputScaleType, fastMath);
+    return hsiImage;
+}
+
+void transformBGRToHSI(const cv::Mat& image, cv::Mat& hsiImage, const int L, const std::string& outputScaleType, const bool fastMath)
 {      
+    if (fastMath && (outputScaleType == "normalized" || outputScaleType == "BGR"))
+    {
+        transformBGRToHSIFast(image, hsiImage, L, outputScaleType == "normalized");
+        return;
+    }
+
     const int maxL = L - 1;
     
     const int rows = image.rows;
@@ -183,10 +424,9 @@ cv::Mat transformBGRToHSI(const cv::Mat& image, const int L, const std::string&
     const double eps = 1e-6;
     const double invMaxLim = 1.0 / maxL; // Precompute maxLim reciprocal for efficiency
 
-    // Initialize hsiImage depending on the scaleType of the output
-    cv::Mat hsiImage;
+    // Initialize hsiImage depending on the scaleType of the output (an existing buffer of the same size and type is reused)
     const int matType = (outputScaleType == "normalized") ? CV_64FC3 : CV_8UC3;
-    hsiImage = cv::Mat(rows, cols, matType);
+    hsiImage.create(rows, cols, matType);
 
     // Loop through each pixel
     for (int row = 0; row < rows; ++row)
@@ -232,7 +472,6 @@ cv::Mat transformBGRToHSI(const cv::Mat& image, const int L, const std::string&
             }
         }
     }
-    return hsiImage;
 }
 
 std::map<double, int> computeChannelHist(const cv::Mat& image, const int channelIndex, const int L, double& cMax, cv::Mat& targetChannel, std::vector<cv::Mat>& otherChannels, const bool verbose)
@@ -240,23 +479,18 @@ std::map<double, int> computeChannelHist(const cv::Mat& image, const int channel
     // Extract the target channel
     cv::extractChannel(image, targetChannel, channelIndex);
 
-    // Initialize histogram for the target channel
-    std::map<double, int> channelHist;
-    for (int c = 0; c < L; ++c)
-    {
-        channelHist[c] = 0;
-    }
+    // Collect the empirical counts and the maximum value of the target channel in a single pass
+    FrameStats stats;
+    computeFrameStats(image, stats, L, channelIndex);
+    cMax = stats.histChannelMax;
 
-    // Populate the histogram counts with the empirical counts from the target channel and collect the maximum value
-    cMax = 0.0;
-    for (int row = 0; row < targetChannel.rows; row++)
+    // Initialize histogram for the target channel and populate it with the empirical counts
+    std::map<double, int> channelHist;
+    for (int c = 0; c < static_cast<int>(stats.hist.size()); ++c)
     {
-        for (int col = 0; col < targetChannel.cols; col++)
+        if (c < L || stats.hist[c] > 0)
         {
-            const double value = targetChannel.at<uchar>(row, col);
-            channelHist[value]++;
-            cMax = std::max(cMax, value);
-            //std::cout << "value: "<< value << ", valueCount: " << channelHist[value] << "\n";
+            channelHist[c] = stats.hist[c];
         }
     }
     if (verbose)
@@ -444,14 +678,85 @@ cv::Mat transformChannel(const cv::Mat image, const int channelIndex, const std:
     return transformedImage;
 }
 
-cv::Mat transformHSIToBGR(const cv::Mat& image, const int L, const std::string& inputScaleType) 
+static void transformHSIToBGRFast(const cv::Mat& image, cv::Mat& bgrImage, const int L, const double scaleFactor)
 {
     const int maxL = L - 1;
     const int rows = image.rows;
     const int cols = image.cols;
+    const double convFactor = CV_PI / 180.0;
+
+    // Hue is stored as an 8-bit code, so its sector and cosine ratio can be tabulated once in double precision
+    uchar hueSector[256];
+    float hueRatio[256];
+    for (int code = 0; code < 256; ++code)
+    {
+        const double h = code * scaleFactor * 360.0;
+        const int sector = (h < 120) ? 0 : ((h < 240) ? 1 : 2);
+        const double h2 = h - 120.0 * sector;
+        hueSector[code] = static_cast<uchar>(sector);
+        hueRatio[code] = static_cast<float>(cos(h2 * convFactor) / cos((60 - h2) * convFactor));
+    }
+
+    bgrImage.create(rows, cols, CV_8UC3);
+    const float scale = static_cast<float>(scaleFactor);
+
+    for (int row = 0; row < rows; ++row)
+    {
+        const cv::Vec3b* srcRow = image.ptr<cv::Vec3b>(row);
+        cv::Vec3b* dstRow = bgrImage.ptr<cv::Vec3b>(row);
+        for (int col = 0; col < cols; ++col)
+        {
+            const uchar hueCode = srcRow[col][2];
+            const float s = srcRow[col][1] * scale;
+            const float i = srcRow[col][0] * scale;
+
+            // The low channel, the cosine-weighted channel and the remainder, rotated by sector (RG, GB, BR)
+            const float low = i * (1 - s);
+            const float high = i * (1 + s * hueRatio[hueCode]);
+            const float rest = 3 * i - (low + high);
+
+            float r, g, b;
+            if (hueSector[hueCode] == 0)
+            {
+                b = low; r = high; g = rest;
+            }
+            else if (hueSector[hueCode] == 1)
+            {
+                r = low; g = high; b = rest;
+            }
+            else
+            {
+                g = low; b = high; r = rest;
+            }
+
+            dstRow[col][0] = static_cast<uchar>(std::clamp(b, 0.0f, 1.0f) * maxL);
+            dstRow[col][1] = static_cast<uchar>(std::clamp(g, 0.0f, 1.0f) * maxL);
+            dstRow[col][2] = static_cast<uchar>(std::clamp(r, 0.0f, 1.0f) * maxL);
+        }
+    }
+}
 
-    // Initialize bgrImage and obtain scale factor depending on the scaleType of the input
-    cv::Mat bgrImage = cv::Mat(rows, cols, CV_8UC3);
+cv::Mat transformHSIToBGR(const cv::Mat& image, const int L, const std::string& inputScaleType, const bool fastMath)
+{
+    cv::Mat bgrImage;
+    transformHSIToBGR(image, bgrImage, L, inputScaleType, fastMath);
+    return bgrImage;
+}
+
+void transformHSIToBGR(const cv::Mat& image, cv::Mat& bgrImage, const int L, const std::string& inputScaleType, const bool fastMath) 
+{
+    if (fastMath)
+    {
+        transformHSIToBGRFast(image, bgrImage, L, (inputScaleType == "normalized") ? 1.0 : 1.0 / (L - 1));
+        return;
+    }
+
+    const int maxL = L - 1;
+    const int rows = image.rows;
+    const int cols = image.cols;
+
+    // Initialize bgrImage (an existing buffer of the same size and type is reused) and obtain scale factor depending on the scaleType of the input
+    bgrImage.create(rows, cols, CV_8UC3);
     const double scaleFactor = (inputScaleType == "normalized") ? 1.0 : 1.0 / maxL;
 
     for (int row = 0; row < rows; ++row) {
@@ -492,36 +797,94 @@ cv::Mat transformHSIToBGR(const cv::Mat& image, const int L, const std::string&
             bgrImage.at<cv::Vec3b>(row, col)[2] = static_cast<uchar>(std::clamp(r, 0.0, 1.0) * maxL);
         }
     }
-   return bgrImage;
 }
 
-void transformAGCWHD(cv::Mat& image, const int L, const std::string fileName, const std::string mode, const bool verbose, const std::string& histDir, const std::string& file)
+std::map<double, double> computeAGCWHDGamma(const std::map<double, int>& channelHist, const int L, const double cMax, const bool verbose)
 {
-    const int channelIndex = 0;
-    double cMax;
-    cv::Mat originalTargetChannel;
-    cv::Mat transformedTargetChannel;
-    std::vector<cv::Mat> originalOtherChannels;
-    std::vector<cv::Mat> transformedOtherChannels;
     int M;
     double pmax, pmin;
     double WHDFSum;
-    int yMax, yMid;
 
-    const cv::Mat originalHSIImage = transformBGRToHSI(image, L, "BGR");
-    const std::map<double, int> originalHSIHist = computeChannelHist(originalHSIImage, channelIndex, L, cMax, originalTargetChannel, originalOtherChannels, verbose);
-    double clippingLimit = computeClippingLimit(originalHSIHist, L, verbose);
-    const std::map<double, int> clippedHSIHist = computeClippedChannelHist(originalHSIHist, clippingLimit, M, verbose);
-    const std::map<double, double> PDF = computePDF(clippedHSIHist, M, pmax, pmin, verbose);
+    const double clippingLimit = computeClippingLimit(channelHist, L, verbose);
+    const std::map<double, int> clippedHist = computeClippedChannelHist(channelHist, clippingLimit, M, verbose);
+    const std::map<double, double> PDF = computePDF(clippedHist, M, pmax, pmin, verbose);
     const std::map<double, double> CDF = computeCDF(PDF);
     const std::map<double, double> WHDF = computeWHDF(PDF, CDF, WHDFSum, pmax, pmin, cMax, verbose);
-    const std::map<double, double> gamma = computeGamma(WHDF, WHDFSum, cMax);
-    cv::Mat transformedHSIImage = transformChannel(originalHSIImage, channelIndex, gamma, cMax, originalTargetChannel, originalOtherChannels);
-    const std::map<double, int> transformedHSIHist = computeChannelHist(transformedHSIImage, channelIndex, L, cMax, transformedTargetChannel, transformedOtherChannels);
-    image = transformHSIToBGR(transformedHSIImage, L, "BGR");
-    if (mode == "image" && !histDir.empty() && !file.empty())
-    {
-        plotHistogram(transformedHSIHist, L, fileName, histDir, file, yMax, yMid, 40, true, false, verbose);
-        plotHistogram(originalHSIHist, L, fileName, histDir, file, yMax, yMid, 40, false, false, verbose);
+    return computeGamma(WHDF, WHDFSum, cMax);
+}
+
+cv::Mat computeGammaLUT(const std::map<double, double>& gamma, const double cMax)
+{
+    // Values without a gamma entry (above cMax) are left unchanged
+    cv::Mat lut(1, 256, CV_8U);
+    for (int value = 0; value < 256; ++value)
+    {
+        const auto gammaIter = gamma.find(value);
+        lut.at<uchar>(0, value) = (gammaIter != gamma.end())
+            ? static_cast<uchar>(round(pow((value / cMax), gammaIter->second) * cMax))
+            : static_cast<uchar>(value);
+    }
+    return lut;
+}
+
+void plotAGCWHDHistograms(const std::map<double, int>& originalHist, const cv::Mat& gammaLUT, const int L, const std::string& fileName, const std::string& histDir, const std::string& file, const bool verbose)
+{
+    // The gamma function maps every intensity code to a single code, so the transformed histogram follows from the original one
+    std::map<double, int> transformedHist;
+    for (int value = 0; value < L; ++value)
+    {
+        transformedHist[value] = 0;
+    }
+    const uchar* lut = gammaLUT.ptr<uchar>(0);
+    for (const auto& bin : originalHist)
+    {
+        transformedHist[lut[static_cast<int>(bin.first)]] += bin.second;
+    }
+
+    int yMax, yMid;
+    plotHistogram(transformedHist, L, fileName, histDir, file, yMax, yMid, 40, true, false, verbose);
+    plotHistogram(originalHist, L, fileName, histDir, file, yMax, yMid, 40, false, false, verbose);
+}
+
+void transformAGCWHD(cv::Mat& image, const int L, const std::string fileName, const bool plotHistograms, const bool verbose, const std::string& histDir, const std::string& file, const bool fastMath, TransformScratch* scratch)
+{
+    const int channelIndex = 0;
+    double cMax;
+
+    // Without buffers of the caller, the HSI images only live for this call
+    TransformScratch localScratch;
+    scratch = (scratch != nullptr) ? scratch : &localScratch;
+
+    const uint64_t pixels = static_cast<uint64_t>(image.total());
+    {
+        ProfileScope profile("transformBGRToHSI", pixels);
+        transformBGRToHSI(image, scratch->hsiImage, L, "BGR", fastMath);
+    }
+    std::map<double, int> originalHSIHist;
+    {
+        ProfileScope profile("computeChannelHist", pixels);
+        originalHSIHist = computeChannelHist(scratch->hsiImage, channelIndex, L, cMax, scratch->targetChannel, scratch->otherChannels, verbose);
+    }
+    std::map<double, double> gamma;
+    cv::Mat gammaLUT;
+    {
+        ProfileScope profile("computeAGCWHDGamma", pixels);
+        gamma = computeAGCWHDGamma(originalHSIHist, L, cMax, verbose);
+    }
+    {
+        // Same mapping as transformChannel, applied through a lookup table and written back into the HSI image
+        ProfileScope profile("transformChannel", pixels);
+        gammaLUT = computeGammaLUT(gamma, cMax);
+        cv::LUT(scratch->targetChannel, gammaLUT, scratch->targetChannel);
+        cv::insertChannel(scratch->targetChannel, scratch->hsiImage, channelIndex);
+    }
+    if (plotHistograms && !histDir.empty() && !file.empty())
+    {
+        plotAGCWHDHistograms(originalHSIHist, gammaLUT, L, fileName, histDir, file, verbose);
+    }
+    {
+        // The image has the size and type of the result, so it is written in place
+        ProfileScope profile("transformHSIToBGR", pixels);
+        transformHSIToBGR(scratch->hsiImage, image, L, "BGR", fastMath);
     }
 }
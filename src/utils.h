@@ -3,6 +3,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <map>
+#include <vector>
 
 // Function to create directories from provided file paths
 void createDirectory(const std::string pathString);
@@ -16,17 +17,60 @@ void calculateYAxisLabels(int maxCount, int& yMax, int& yMid);
 // Function to fit an image to a window
 cv::Mat fitImageToWindow(const cv::Mat& image, int windowMaxWidth, int windowMaxHeight);
 
-// Function to apply color channel stretching
-void stretchColorChannels(const cv::Mat& image, const int minL, const int L);
+// Statistics of an image/frame, gathered in a single pass
+struct FrameStats
+{
+    std::vector<double> channelMin;     // Minimum value per channel
+    std::vector<double> channelMax;     // Maximum value per channel
+    std::vector<int> hist;              // Histogram of the histogram channel (empty if none was requested)
+    double histChannelMax = 0.0;        // Maximum value of the histogram channel
+};
+
+// Buffers of the transforms that can be kept across frames, so enhancing a stream does not reallocate them for every frame
+struct TransformScratch
+{
+    FrameStats stats;                   // Statistics of the current frame
+    cv::Mat stretchLUT;                 // Lookup table of the color channel stretching
+    cv::Mat transformLUT;               // Lookup table of the logarithmic transformation
+    std::vector<cv::Mat> channels;      // Split channels of the histogram equalization
+    cv::Mat hsiImage;                   // HSI image of the AGCWHD, transformed in place
+    cv::Mat targetChannel;              // Intensity channel of the AGCWHD
+    std::vector<cv::Mat> otherChannels; // Hue and saturation channels of the AGCWHD
+    cv::Mat tileLUTs;                   // Tile lookup tables of the locHE gain map
+};
+
+// Function to compute per-channel min/max and, optionally, the histogram of one channel in a single multi-threaded pass
+void computeFrameStats(const cv::Mat& image, FrameStats& stats, const int L = 256, const int histChannel = -1);
+
+// Function to build the per-channel lookup table of the color channel stretching (stats are updated to describe the stretched image)
+cv::Mat computeStretchLUT(FrameStats& stats, const int minL, const int L);
+void computeStretchLUT(FrameStats& stats, const int minL, const int L, cv::Mat& lut);
+
+// Function to apply color channel stretching (if provided, stats must describe the image and are updated to describe the stretched image,
+// and the lookup table is built in lut)
+void stretchColorChannels(const cv::Mat& image, const int minL, const int L, FrameStats* stats = nullptr, cv::Mat* lut = nullptr);
+
+// Function to apply the logarithmic transformation (if provided, stats must describe the image, and the lookup table is built in lut)
+void transformLogarithmic(const cv::Mat& image, const double inputScale, const int L, const FrameStats* stats = nullptr, cv::Mat* lut = nullptr);
 
-// Function to apply the logarithmic transformation
-void transformLogarithmic(const cv::Mat& image, const double inputScale, const int L);
+// Function to build the per-channel lookup table of the logarithmic transformation
+cv::Mat computeLogLUT(const FrameStats& stats, const double inputScale, const int L);
+void computeLogLUT(const FrameStats& stats, const double inputScale, const int L, cv::Mat& lut);
 
-// Function to apply histogram equalization, either locally (CLAHE) or globally
-void transformHistEqual(const cv::Mat& image, const double clipLimit = 40, const cv::Size& tileGridSize = cv::Size(8, 8), const std::string& equalType = "local");
+// Function to build the lookup table of global histogram equalization (identical to cv::equalizeHist) from a 256-bin histogram
+cv::Mat computeEqualizeLUT(const std::vector<int>& hist);
+
+// Function to get a cached CLAHE object for the given parameters, so it is reused across frames and jobs
+cv::Ptr<cv::CLAHE> getCLAHE(const double clipLimit, const cv::Size& tileGridSize);
+
+// Function to apply histogram equalization, either locally (CLAHE) or globally (if provided, the channels are split into channels)
+void transformHistEqual(const cv::Mat& image, const double clipLimit = 40, const cv::Size& tileGridSize = cv::Size(8, 8), const std::string& equalType = "local", std::vector<cv::Mat>* channels = nullptr);
 
 // Function to apply a BGR to HSI transformation
-cv::Mat transformBGRToHSI(const cv::Mat& image, const int L, const std::string& scaleType = "BGR");
+// With fastMath, a minimax polynomial for acos is used instead of std::acos (hue error below 5e-5 rad); hues close to a code
+// boundary fall back to std::acos, so the 'BGR' output codes are identical to the exact path
+cv::Mat transformBGRToHSI(const cv::Mat& image, const int L, const std::string& scaleType = "BGR", const bool fastMath = false);
+void transformBGRToHSI(const cv::Mat& image, cv::Mat& hsiImage, const int L, const std::string& scaleType = "BGR", const bool fastMath = false);
 
 // Function to compute a histogram for a certain channel
 std::map<double, int> computeChannelHist(const cv::Mat& image, const int channelIndex, const int L, double& cMax, cv::Mat& targetChannel, std::vector<cv::Mat>& otherChannels, const bool verbose = false);
@@ -53,10 +97,23 @@ std::map<double, double> computeGamma(const std::map<double, double>& WHDF, cons
 cv::Mat transformChannel(const cv::Mat image, const int channelIndex, const std::map<double, double> gamma, const double cMax, cv::Mat& targetChannel, std::vector<cv::Mat>& otherChannels);
 
 // Function to apply an HSI to BGR transformation
-cv::Mat transformHSIToBGR(const cv::Mat& image, const int L, const std::string& inputScaleType = "BGR");
+// With fastMath, float32 arithmetic and a per-hue lookup table for the cosine ratio are used instead of double precision trigonometry
+// (each output channel differs from the exact path by at most 1 LSB over all HSI codes)
+cv::Mat transformHSIToBGR(const cv::Mat& image, const int L, const std::string& inputScaleType = "BGR", const bool fastMath = false);
+void transformHSIToBGR(const cv::Mat& image, cv::Mat& bgrImage, const int L, const std::string& inputScaleType = "BGR", const bool fastMath = false);
+
+// Function to compute the AGCWHD gamma function from an intensity histogram (clipping, PDF, CDF, WHDF and gamma in one go)
+std::map<double, double> computeAGCWHDGamma(const std::map<double, int>& channelHist, const int L, const double cMax, const bool verbose = false);
+
+// Function to build a lookup table from the gamma function, equivalent to transformChannel
+cv::Mat computeGammaLUT(const std::map<double, double>& gamma, const double cMax);
+
+// Function to plot the original intensity histogram of the AGCWHD and the transformed one, derived through the gamma lookup table
+void plotAGCWHDHistograms(const std::map<double, int>& originalHist, const cv::Mat& gammaLUT, const int L, const std::string& fileName, const std::string& histDir, const std::string& file, const bool verbose = false);
 
 // Function to apply the Adaptive Gamma Correction with Weighted Histogram Distribution (AGCWHD) proposed by Veluchamy & Subramani (2019)
-void transformAGCWHD(cv::Mat& image, const int L, const std::string fileName, const std::string mode, const bool verbose = false, const std::string& histPath = "", const std::string& file = "");
+// (the histograms are only plotted with plotHistograms and a histPath and file; if provided, the HSI images live in scratch)
+void transformAGCWHD(cv::Mat& image, const int L, const std::string fileName, const bool plotHistograms, const bool verbose = false, const std::string& histPath = "", const std::string& file = "", const bool fastMath = false, TransformScratch* scratch = nullptr);
 
 // Function for histogram plotting from both std::map<double, double> and std::map<double, int>
 template <typename T>
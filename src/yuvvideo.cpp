@@ -0,0 +1,349 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "utils.h"
+#include "perfcounters.h"
+#include "yuvvideo.h"
+#include "frameselect.h"
+#include "autoselect.h"
+#include "passthrough.h"
+
+// Frame rate assumed for videos that do not report one
+static const double defaultFps = 25.0;
+
+// Function to turn a fourcc code into its four characters, for messages
+static std::string fourccToString(const int fourcc)
+{
+    std::string text;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        const char c = static_cast<char>((fourcc >> shift) & 0xFF);
+        text += std::isprint(static_cast<unsigned char>(c)) ? c : '?';
+    }
+    return text;
+}
+
+// Function to convert a decoded frame to planar I420, returns false if its layout is not recognized (unknown pixel formats included)
+// (frames the backend still converted to BGR cost one conversion, NV12/YV12 only a reordering of the chroma)
+static bool toI420(const cv::Mat& frame, const int pixelFormat, const cv::Size& size, cv::Mat& i420)
+{
+    if (frame.type() == CV_8UC3)
+    {
+        cv::cvtColor(frame, i420, cv::COLOR_BGR2YUV_I420);
+        return true;
+    }
+    if (frame.type() != CV_8UC1 || frame.rows != size.height * 3 / 2 || frame.cols != size.width || !frame.isContinuous())
+    {
+        return false;
+    }
+
+    const int lumaSize = size.area();
+    const int chromaSize = lumaSize / 4;
+    if (pixelFormat == cv::VideoWriter::fourcc('N', 'V', '1', '2'))
+    {
+        i420.create(frame.size(), CV_8UC1);
+        std::copy(frame.data, frame.data + lumaSize, i420.data);
+        const uchar* uv = frame.data + lumaSize;
+        uchar* u = i420.data + lumaSize;
+        uchar* v = u + chromaSize;
+        for (int i = 0; i < chromaSize; ++i)
+        {
+            u[i] = uv[2 * i];
+            v[i] = uv[2 * i + 1];
+        }
+    }
+    else if (pixelFormat == cv::VideoWriter::fourcc('Y', 'V', '1', '2'))
+    {
+        i420.create(frame.size(), CV_8UC1);
+        std::copy(frame.data, frame.data + lumaSize, i420.data);
+        std::copy(frame.data + lumaSize + chromaSize, frame.data + lumaSize + 2 * chromaSize, i420.data + lumaSize);
+        std::copy(frame.data + lumaSize, frame.data + lumaSize + chromaSize, i420.data + lumaSize + chromaSize);
+    }
+    else if (pixelFormat == cv::VideoWriter::fourcc('I', '4', '2', '0') || pixelFormat == cv::VideoWriter::fourcc('I', 'Y', 'U', 'V'))
+    {
+        // I420/IYUV, which the decoders of most codecs produce natively
+        i420 = frame;
+    }
+    else
+    {
+        // Other layouts with the same size (e.g. 4:2:2 packed into rows) cannot be told apart, so they are rejected
+        return false;
+    }
+    return true;
+}
+
+// Function to get the luma and chroma planes of an I420 frame as headers over its data
+static void splitPlanes(cv::Mat& i420, cv::Mat& y, cv::Mat& u, cv::Mat& v)
+{
+    const int height = i420.rows * 2 / 3;
+    const int width = i420.cols;
+    y = cv::Mat(height, width, CV_8UC1, i420.data);
+    u = cv::Mat(height / 2, width / 2, CV_8UC1, i420.data + height * width);
+    v = cv::Mat(height / 2, width / 2, CV_8UC1, i420.data + height * width + (height / 2) * (width / 2));
+}
+
+// Function to fit an I420 frame to a window (like fitImageToWindow), resizing each plane on its own
+static cv::Mat fitYUVToWindow(cv::Mat& i420, const cv::Size& outputSize)
+{
+    if (i420.cols == outputSize.width && i420.rows * 2 / 3 == outputSize.height)
+    {
+        return i420;
+    }
+    cv::Mat y, u, v;
+    splitPlanes(i420, y, u, v);
+    cv::Mat resized(outputSize.height * 3 / 2, outputSize.width, CV_8UC1);
+    cv::Mat resizedY, resizedU, resizedV;
+    splitPlanes(resized, resizedY, resizedU, resizedV);
+    cv::resize(y, resizedY, resizedY.size(), 0, 0, cv::INTER_AREA);
+    cv::resize(u, resizedU, resizedU.size(), 0, 0, cv::INTER_AREA);
+    cv::resize(v, resizedV, resizedV.size(), 0, 0, cv::INTER_AREA);
+    return resized;
+}
+
+void enhanceFrameYUV(cv::Mat& i420, const EnhancementSettings& settings)
+{
+    // The "auto" transform type is chosen from the features of the luma plane (ranked by the costs of the BGR path)
+    if (settings.transformType == "auto")
+    {
+        EnhancementSettings chosenSettings = settings;
+        chosenSettings.transformType = selectTransform(i420.rowRange(0, i420.rows * 2 / 3), settings).transformType;
+        enhanceFrameYUV(i420, chosenSettings);
+        return;
+    }
+
+    cv::Mat y, u, v;
+    splitPlanes(i420, y, u, v);
+    const int maxL = settings.L - 1;
+
+    // Stretching the luma range to [0, L - 1] also takes it from the video range to the full range
+    FrameStats stats;
+    computeFrameStats(y, stats, settings.L, 0);
+    const std::vector<int> rawHist = stats.hist;
+    const cv::Mat stretchLut = computeStretchLUT(stats, 0, settings.L);
+    const uchar* stretch = stretchLut.ptr<uchar>(0);
+
+    std::vector<int> stretchedHist(std::max(settings.L, 256), 0);
+    for (int value = 0; value < 256; ++value)
+    {
+        stretchedHist[stretch[value]] += rawHist[value];
+    }
+
+    // Back to the video range (16 - 235) at the end
+    cv::Mat videoRangeLut(1, 256, CV_8U);
+    for (int value = 0; value < 256; ++value)
+    {
+        videoRangeLut.at<uchar>(0, value) = cv::saturate_cast<uchar>(16.0 + value * 219.0 / maxL);
+    }
+
+    cv::Mat transformLut;
+    if (settings.transformType == "log")
+    {
+        transformLut = computeLogLUT(stats, settings.inputScale, settings.L);
+    }
+    else if (settings.transformType == "globHE")
+    {
+        transformLut = computeEqualizeLUT(stretchedHist);
+    }
+    else if (settings.transformType == "AGCWHD")
+    {
+        // The luma takes the role of the HSI intensity
+        std::map<double, int> channelHist;
+        double cMax = 0.0;
+        for (int value = 0; value < static_cast<int>(stretchedHist.size()); ++value)
+        {
+            if (value < settings.L || stretchedHist[value] > 0)
+            {
+                channelHist[value] = stretchedHist[value];
+            }
+            if (stretchedHist[value] > 0)
+            {
+                cMax = value;
+            }
+        }
+        transformLut = computeGammaLUT(computeAGCWHDGamma(channelHist, settings.L, cMax), cMax);
+    }
+    else if (settings.transformType == "locHE")
+    {
+        // CLAHE is not a per-pixel mapping, so it runs on the stretched luma between the two lookup tables
+        cv::LUT(y, stretchLut, y);
+        getCLAHE(settings.clipLimit, settings.tileGridSize)->apply(y, y);
+        cv::LUT(y, videoRangeLut, y);
+        return;
+    }
+
+    // Stretching, the transformation and the range conversion in one lookup table
+    cv::Mat combinedLut;
+    cv::LUT(stretchLut, transformLut, combinedLut);
+    cv::LUT(combinedLut, videoRangeLut, combinedLut);
+
+    if (settings.transformType == "AGCWHD")
+    {
+        // Scale the chroma by the mean gain of each 2 x 2 luma block, as scaling the intensity keeps hue and saturation in HSI
+        std::vector<float> gains(256, 1.0f);
+        const uchar* gamma = transformLut.ptr<uchar>(0);
+        for (int value = 0; value < 256; ++value)
+        {
+            if (stretch[value] > 0)
+            {
+                gains[value] = static_cast<float>(gamma[stretch[value]]) / stretch[value];
+            }
+        }
+        cv::parallel_for_(cv::Range(0, u.rows), [&](const cv::Range& range)
+        {
+            for (int row = range.start; row < range.end; ++row)
+            {
+                const uchar* top = y.ptr<uchar>(2 * row);
+                const uchar* bottom = y.ptr<uchar>(2 * row + 1);
+                uchar* uRow = u.ptr<uchar>(row);
+                uchar* vRow = v.ptr<uchar>(row);
+                for (int col = 0; col < u.cols; ++col)
+                {
+                    const float gain = 0.25f * (gains[top[2 * col]] + gains[top[2 * col + 1]] + gains[bottom[2 * col]] + gains[bottom[2 * col + 1]]);
+                    uRow[col] = static_cast<uchar>(std::clamp(128.0f + (uRow[col] - 128) * gain, 16.0f, 240.0f) + 0.5f);
+                    vRow[col] = static_cast<uchar>(std::clamp(128.0f + (vRow[col] - 128) * gain, 16.0f, 240.0f) + 0.5f);
+                }
+            }
+        });
+    }
+    cv::LUT(y, combinedLut, y);
+}
+
+bool processVideoYUV(
+    const std::string& rawVideoPath, const std::string& modVideoFilePath, const EnhancementSettings& settings, const bool verbose)
+{
+    cv::VideoCapture cap(rawVideoPath);
+    if (!cap.isOpened())
+    {
+        std::cerr << "Error: Video file could not be opened." << "\n";
+        return false;
+    }
+
+    // Ask the backend for the decoder's native frames instead of BGR
+    const bool rawFrames = cap.set(cv::CAP_PROP_CONVERT_RGB, 0);
+    const int pixelFormat = static_cast<int>(cap.get(cv::CAP_PROP_CODEC_PIXEL_FORMAT));
+
+    createDirectory(modVideoFilePath);
+    const int frameWidth = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
+    const int frameHeight = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+    double fps = cap.get(cv::CAP_PROP_FPS);
+    if (!(fps > 0.0 && fps < 1000.0))
+    {
+        // Some containers and raw streams carry no frame rate; Y4M and mp4 both need one
+        std::cerr << "Warning: Video has no valid frame rate, " << defaultFps << " fps are assumed." << "\n";
+        fps = defaultFps;
+    }
+
+    // Same output size as fitImageToWindow, rounded to even dimensions for the subsampled chroma
+    const double scaleFactor = std::min(1.0, std::min(1280.0 / frameWidth, 720.0 / frameHeight));
+    const cv::Size outputSize(std::max(2, cvRound(frameWidth * scaleFactor) & ~1), std::max(2, cvRound(frameHeight * scaleFactor) & ~1));
+
+    if (verbose)
+    {
+        std::cout << "frameWidth: " << frameWidth << ", frameHeight: " << frameHeight << ", fps: " << fps
+            << ", native YUV frames: " << (rawFrames ? "requested" : "not supported by the backend") << "\n";
+    }
+    if (settings.denoiseFrames > 0 || settings.tileSkipSize > 0 || settings.gainMapScale > 1 || !settings.renditions.empty() || settings.frameCacheMaxMB > 0)
+    {
+        std::cerr << "Warning: Temporal denoising, tile skipping, gain maps, renditions and the frame cache are not supported on the YUV path and are ignored.\n";
+    }
+
+    // Only read the selected frames (for previews), seeking over larger gaps
+    FrameSelector selector(cap, settings);
+    const bool writeStills = (settings.previewOutput == "stills");
+
+    const bool writeY4M = (settings.yuvOutput == "y4m") && !writeStills;
+    std::ofstream y4m;
+    cv::VideoWriter writer;
+    if (writeY4M)
+    {
+        y4m.open(modVideoFilePath, std::ios::binary | std::ios::trunc);
+        if (y4m.is_open())
+        {
+            // 4:2:0 with MPEG-2 chroma siting (as produced by the video decoders), frame rate as a fraction in thousandths
+            y4m << "YUV4MPEG2 W" << outputSize.width << " H" << outputSize.height << " F" << cvRound(fps * 1000) << ":1000 Ip A1:1 C420mpeg2\n";
+        }
+    }
+    else if (!writeStills)
+    {
+        writer.open(modVideoFilePath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, outputSize);
+    }
+    if (!writeStills && (writeY4M ? !y4m.is_open() : !writer.isOpened()))
+    {
+        std::cerr << "Error: Video writer could not be opened." << "\n";
+        return false;
+    }
+
+    // Well-exposed frames are written without enhancing their luma
+    std::unique_ptr<PassThroughGate> gate;
+    if (settings.passThroughThreshold > 0.0)
+    {
+        gate = std::make_unique<PassThroughGate>(settings.passThroughThreshold, settings.passThroughHysteresis, settings.L);
+    }
+
+    cv::Mat frame, i420, bgr;
+    int frameCount = 0;
+    int frameIndex = 0;
+    bool convertedFrames = false;
+    while (selector.read(frame, frameIndex))
+    {
+        convertedFrames = convertedFrames || (frame.type() == CV_8UC3);
+        if (!toI420(frame, pixelFormat, cv::Size(frameWidth, frameHeight), i420))
+        {
+            std::cerr << "Error: Unsupported decoded frame layout on the YUV path (pixel format " << fourccToString(pixelFormat) << ")." << "\n";
+            return false;
+        }
+
+        cv::Mat output = fitYUVToWindow(i420, outputSize);
+        if (!gate || !gate->check(output.rowRange(0, outputSize.height)))
+        {
+            ProfileScope profile("enhanceFrameYUV", static_cast<uint64_t>(outputSize.area()));
+            enhanceFrameYUV(output, settings);
+        }
+
+        if (writeStills)
+        {
+            cv::cvtColor(output, bgr, cv::COLOR_YUV2BGR_I420);
+            const std::filesystem::path stillPath = std::filesystem::path(modVideoFilePath)
+                / (std::filesystem::path(rawVideoPath).stem().string() + "_" + std::to_string(frameIndex) + ".jpg");
+            if (!saveImage(bgr, stillPath.string()))
+            {
+                return false;
+            }
+        }
+        else if (writeY4M)
+        {
+            y4m << "FRAME\n";
+            y4m.write(reinterpret_cast<const char*>(output.data), static_cast<std::streamsize>(output.total()));
+        }
+        else
+        {
+            cv::cvtColor(output, bgr, cv::COLOR_YUV2BGR_I420);
+            writer.write(bgr);
+        }
+        frameCount++;
+    }
+
+    cap.release();
+    writer.release();
+    if (verbose && gate && gate->checkedFrames() > 0)
+    {
+        std::cout << "Frames passed through unchanged: " << gate->passedFrames() << " of " << gate->checkedFrames()
+            << " (" << 100.0 * gate->passedFrames() / gate->checkedFrames() << "%)\n";
+    }
+    if (verbose && convertedFrames)
+    {
+        std::cout << "The backend delivered BGR frames, which were converted to YUV once per frame\n";
+    }
+    if (verbose)
+    {
+        std::cout << "Processed video (" << frameCount << " frames on the YUV path) saved under: " << modVideoFilePath << "\n";
+    }
+    return true;
+}
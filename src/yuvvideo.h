@@ -0,0 +1,18 @@
+#ifndef YUV_VIDEO_H
+#define YUV_VIDEO_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "processor.h"
+
+// Function to enhance the luma plane of a planar I420 frame (height * 3 / 2 rows of 8-bit samples) in place
+// Luma is stretched and transformed by a single lookup table (CLAHE for 'locHE'); for 'AGCWHD', chroma follows the luma gain
+// like the HSI intensity, so the saturation is kept
+void enhanceFrameYUV(cv::Mat& i420, const EnhancementSettings& settings);
+
+// Function to process a video on its planar YUV frames, written either as a YUV4MPEG2 stream without any color conversion
+// ('y4m') or converted to BGR once for the mp4 writer ('mp4')
+bool processVideoYUV(
+    const std::string& rawVideoPath, const std::string& modVideoFilePath, const EnhancementSettings& settings, const bool verbose);
+
+#endif
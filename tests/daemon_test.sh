@@ -0,0 +1,94 @@
+#!/bin/sh
+# Integration test of daemon mode: starts the daemon, sends requests through client mode and checks the replies
+# Usage: daemon_test.sh <boost executable> <raw image>
+set -u
+
+BOOST="$1"
+RAW_IMAGE="$2"
+WORK_DIR=$(mktemp -d)
+SOCKET="$WORK_DIR/daemon.sock"
+DAEMON_PID=""
+SHM_NAME="boost_daemon_test_$$"
+
+cleanup()
+{
+    if [ -n "$DAEMON_PID" ]; then
+        kill "$DAEMON_PID" 2>/dev/null
+    fi
+    rm -rf "$WORK_DIR"
+    rm -f "/dev/shm/$SHM_NAME"
+}
+trap cleanup EXIT
+
+fail()
+{
+    echo "FAIL: $1"
+    exit 1
+}
+
+# The result is written to <raw dir>/../mod, so the raw image is copied into the temporary directory
+mkdir -p "$WORK_DIR/raw"
+cp "$RAW_IMAGE" "$WORK_DIR/raw/" || fail "raw image $RAW_IMAGE could not be copied"
+RAW_NAME=$(basename "$RAW_IMAGE")
+RAW_STEM="${RAW_NAME%.*}"
+
+"$BOOST" daemon "$SOCKET" 2 &
+DAEMON_PID=$!
+tries=0
+while [ ! -S "$SOCKET" ]; do
+    tries=$((tries + 1))
+    [ "$tries" -le 100 ] || fail "daemon did not create its socket"
+    kill -0 "$DAEMON_PID" 2>/dev/null || fail "daemon exited on startup"
+    sleep 0.1
+done
+
+# A file job is enhanced and its output written
+reply=$("$BOOST" client "$SOCKET" "{\"mode\": \"image\", \"rawFilePath\": \"$WORK_DIR/raw/$RAW_NAME\", \"transformType\": \"globHE\"}")
+echo "$reply"
+echo "$reply" | grep -q '"status": "ok"' || fail "file job was not enhanced"
+[ -f "$WORK_DIR/mod/${RAW_STEM}_globHE.jpg" ] || fail "enhanced image was not written"
+
+# A shared memory frame is enhanced in place (POSIX shared memory objects live in /dev/shm on Linux)
+if [ -d /dev/shm ]; then
+    # A dark 64x48 BGR frame of noise, which AGCWHD brightens
+    head -c 9216 /dev/urandom | LC_ALL=C tr '\200-\377' '\000-\177' > "/dev/shm/$SHM_NAME" || fail "shared memory frame could not be created"
+    cp "/dev/shm/$SHM_NAME" "$WORK_DIR/frame.raw"
+    reply=$("$BOOST" client "$SOCKET" "{\"shm\": \"/$SHM_NAME\", \"width\": 64, \"height\": 48, \"transformType\": \"AGCWHD\"}")
+    echo "$reply"
+    echo "$reply" | grep -q '"status": "ok"' || fail "shared memory frame was not enhanced"
+    [ "$(wc -c < "/dev/shm/$SHM_NAME")" -eq 9216 ] || fail "shared memory object changed its size"
+    ! cmp -s "/dev/shm/$SHM_NAME" "$WORK_DIR/frame.raw" || fail "shared memory frame was not written back"
+
+    # A frame larger than the shared memory object is rejected
+    reply=$("$BOOST" client "$SOCKET" "{\"shm\": \"/$SHM_NAME\", \"width\": 640, \"height\": 480, \"transformType\": \"AGCWHD\"}")
+    echo "$reply"
+    echo "$reply" | grep -q '"status": "error"' || fail "oversized shared memory frame was not rejected"
+fi
+
+# Malformed requests and invalid jobs are answered with an error, and the daemon keeps serving
+reply=$("$BOOST" client "$SOCKET" "not json")
+echo "$reply"
+echo "$reply" | grep -q '"status": "error"' || fail "malformed request was not rejected"
+reply=$("$BOOST" client "$SOCKET" "{\"mode\": \"image\"}")
+echo "$reply"
+echo "$reply" | grep -q '"status": "error"' || fail "invalid job was not rejected"
+
+# An idle connection does not hold on to a worker, so a request on another connection is still answered
+if command -v nc >/dev/null 2>&1; then
+    (sleep 5 | nc -U "$SOCKET" >/dev/null 2>&1) &
+    (sleep 5 | nc -U "$SOCKET" >/dev/null 2>&1) &
+    sleep 0.2
+    reply=$("$BOOST" client "$SOCKET" "{\"mode\": \"image\"}")
+    echo "$reply" | grep -q '"status": "error"' || fail "request was not answered while other connections were idle"
+fi
+
+reply=$("$BOOST" client "$SOCKET" "{\"command\": \"shutdown\"}")
+echo "$reply"
+echo "$reply" | grep -q '"status": "ok"' || fail "shutdown was not acknowledged"
+wait "$DAEMON_PID"
+status=$?
+DAEMON_PID=""
+[ "$status" -eq 0 ] || fail "daemon exited with status $status"
+[ ! -e "$SOCKET" ] || fail "daemon did not remove its socket"
+
+echo "PASS"